@@ -7,9 +7,31 @@
 
 #ifndef HLIBS_MPI_HELPERS_H
 #define HLIBS_MPI_HELPERS_H
-#include <MPI.h>
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  /* cpu_set_t and sched_getaffinity. Only effective if no system header came before */
+#endif
+#ifdef HLIBS_MPI_STUB
+#include "MPI_stub.h"  /* Serial stand-in, a single rank */
+#else
+#include <mpi.h>
+#endif
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <dirent.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#include "stats.h"
+#include "dynarray.h"
+#include "hash.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 
 static inline void MPIh_initialize(int argc, char **argv, int *rank_MPI, int *size_MPI) 
@@ -20,8 +42,126 @@ static inline void MPIh_initialize(int argc, char **argv, int *rank_MPI, int *si
 }
 
 
-static inline int MPIh_schedule_work(int rank_MPI, int size_MPI, int N_tot)
+/* Hybrid MPI + OpenMP start-up. Requests the thread support level `required` 
+ * (MPI_THREAD_FUNNELED: only the master thread calls MPI, MPI_THREAD_MULTIPLE: any thread)
+ * and fails if the library provides less. Ranks sharing a node get a node communicator 
+ * (MPI_Comm_split_type) and compare their allowed CPU sets (sched_getaffinity). A rank whose
+ * set no other rank on the node shares was bound by the launcher, and keeps it. Ranks sharing 
+ * a set (no binding, or one cgroup / Slurm mask for all of them) split its CPUs evenly. With
+ * configure_omp, the OpenMP team is sized to the rank's cores and a rank sharing its set is
+ * pinned to its own slice of it (threads inherit it), so ranks on a node do not oversubscribe. */
+typedef struct MPIh_topology {
+    int rank, size;
+    int provided;         /* Thread support level granted by MPI */
+    MPI_Comm node;        /* Ranks on this node */
+    int node_rank, node_size;
+    int node_id, nnodes;  /* Nodes numbered in order of their lowest rank */
+    int cores_node;       /* Online cores of the node */
+    int cores;            /* Cores available to this rank */
+    int numa;             /* NUMA domains of the node (1 if unknown) */
+    int threads;          /* OpenMP threads per rank (1 without OpenMP) */
+} s_MPIh_topology;
+
+static inline int MPIh_numa_domains(void)
+{   /* Counts /sys/devices/system/node/nodeN, 1 if not available */
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (!dir) return 1;
+    int n = 0;
+    struct dirent *e;
+    while ((e = readdir(dir))) {
+        if (strncmp(e->d_name, "node", 4) == 0 && e->d_name[4] >= '0' && e->d_name[4] <= '9') n++;
+    }
+    closedir(dir);
+    return n > 0 ? n : 1;
+}
+
+static inline int MPIh_initialize_hybrid(int *argc, char ***argv, int required, bool configure_omp, s_MPIh_topology *topo)
+{   /* 0 if ERROR (insufficient thread support), MPI stays initialised so the caller can abort */
+    MPI_Init_thread(argc, argv, required, &topo->provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &topo->rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &topo->size);
+    if (topo->provided < required) {
+        if (topo->rank == 0) fprintf(stderr, "MPIh_initialize_hybrid: thread support %d requested, %d provided.\n", required, topo->provided);
+        topo->node = MPI_COMM_NULL;
+        return 0;
+    }
+
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, topo->rank, MPI_INFO_NULL, &topo->node);
+    MPI_Comm_rank(topo->node, &topo->node_rank);
+    MPI_Comm_size(topo->node, &topo->node_size);
+    int leader = topo->node_rank == 0;
+    MPI_Exscan(&leader, &topo->node_id, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (topo->rank == 0) topo->node_id = 0;
+    MPI_Bcast(&topo->node_id, 1, MPI_INT, 0, topo->node);
+    MPI_Allreduce(&leader, &topo->nnodes, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    topo->cores_node = online > 0 ? (int)online : 1;
+    topo->numa = MPIh_numa_domains();
+#ifdef CPU_SET
+    cpu_set_t mask;
+    if (sched_getaffinity(0, sizeof(mask), &mask) != 0) {
+        CPU_ZERO(&mask);
+        for (int c = 0; c < topo->cores_node && c < CPU_SETSIZE; c++) CPU_SET(c, &mask);
+    }
+    cpu_set_t *masks = malloc(topo->node_size * sizeof(cpu_set_t));
+    bool error = !masks, global_error;
+    MPI_Allreduce(&error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) {
+        fprintf(stderr, "MPIh_initialize_hybrid: out of memory.\n");
+        free(masks);
+        return 0;
+    }
+    MPI_Allgather(&mask, sizeof(mask), MPI_BYTE, masks, sizeof(mask), MPI_BYTE, topo->node);
+    int nsharing = 0, slot = 0;  /* Ranks on the node with this same set, and our place among them */
+    for (int r = 0; r < topo->node_size; r++) {
+        if (!CPU_EQUAL(&masks[r], &mask)) continue;
+        if (r < topo->node_rank) slot++;
+        nsharing++;
+    }
+    free(masks);
+
+    /* Even split of the set's CPUs, in increasing order, the first ranks take the remainder */
+    int ncpus = CPU_COUNT(&mask);
+    int share = ncpus / nsharing, extra = ncpus % nsharing;
+    int first = slot * share + (slot < extra ? slot : extra);
+    topo->cores = share + (slot < extra);
+    if (topo->cores < 1) topo->cores = 1;  /* More ranks than CPUs */
+    if (configure_omp && nsharing > 1 && ncpus > 0) {
+        cpu_set_t mine;
+        CPU_ZERO(&mine);
+        if (share == 0) first = slot % ncpus;
+        for (int c = 0, k = 0; c < CPU_SETSIZE && k < first + topo->cores; c++) {
+            if (!CPU_ISSET(c, &mask)) continue;
+            if (k >= first) CPU_SET(c, &mine);
+            k++;
+        }
+        if (sched_setaffinity(0, sizeof(mine), &mine) != 0) fprintf(stderr, "MPIh_initialize_hybrid: could not bind rank %d.\n", topo->rank);
+    }
+#else
+    topo->cores = topo->cores_node / topo->node_size + (topo->node_rank < topo->cores_node % topo->node_size);
+    if (topo->cores < 1) topo->cores = 1;
+#endif
+
+    topo->threads = 1;
+#ifdef _OPENMP
+    if (configure_omp) omp_set_num_threads(topo->cores);
+    topo->threads = omp_get_max_threads();
+#else
+    (void)configure_omp;
+#endif
+    return 1;
+}
+
+static inline void MPIh_topology_free(s_MPIh_topology *topo)
 {
+    if (topo->node != MPI_COMM_NULL) MPI_Comm_free(&topo->node);
+}
+
+
+static inline int MPIh_schedule_work(int rank_MPI, int size_MPI, int N_tot)
+{   /* Number of items of this rank, the last one takes the remainder. 
+     * See MPIh_partition_block for balanced ranges with 64-bit indices */
     int workload_MPI = N_tot / size_MPI;
     int remainder_MPI = N_tot % size_MPI;
     if (rank_MPI == size_MPI - 1) return workload_MPI + remainder_MPI;
@@ -29,6 +169,331 @@ static inline int MPIh_schedule_work(int rank_MPI, int size_MPI, int N_tot)
 }
 
 
+/* Partitions of N items [0, N) among size ranks, as [begin, end) ranges.
+ * Block: contiguous ranges whose lengths differ by at most one (the first N % size ranks 
+ * get one more item). Block-cyclic: blocks of B items dealt round-robin, block g goes to 
+ * rank g % size; a rank iterates over its blocks with MPIh_cyclic_block. Weighted: 
+ * contiguous ranges with similar total cost, from per-item cost estimates; item i goes to 
+ * the rank whose share of the total cost contains the midpoint of its cost, located by binary
+ * search on the prefix sum of costs. */
+typedef struct MPIh_range {
+    int64_t begin, end;
+} s_MPIh_range;
+
+static inline s_MPIh_range MPIh_partition_block(int rank, int size, int64_t N)
+{   /* O(1) */
+    int64_t q = N / size, r = N % size;
+    int64_t begin = rank * q + (rank < r ? rank : r);
+    return (s_MPIh_range){ .begin = begin, .end = begin + q + (rank < r) };
+}
+
+static inline int MPIh_partition_block_owner(int size, int64_t N, int64_t i)
+{   /* Rank whose block contains item i. O(1) */
+    int64_t q = N / size, r = N % size;
+    if (i < r * (q + 1)) return (int)(i / (q + 1));
+    return (int)(r + (i - r * (q + 1)) / q);
+}
+
+static inline int64_t MPIh_cyclic_nblocks(int rank, int size, int64_t N, int64_t B)
+{   /* Number of blocks of rank */
+    int64_t nblocks = (N + B - 1) / B;
+    return nblocks / size + (rank < nblocks % size);
+}
+
+static inline s_MPIh_range MPIh_cyclic_block(int rank, int size, int64_t N, int64_t B, int64_t j)
+{   /* j-th block of rank, j in [0, MPIh_cyclic_nblocks) */
+    int64_t g = j * size + rank;
+    int64_t begin = g * B;
+    return (s_MPIh_range){ .begin = begin, .end = begin + B < N ? begin + B : N };
+}
+
+static inline int MPIh_cyclic_owner(int size, int64_t B, int64_t i)
+{
+    return (int)((i / B) % size);
+}
+
+static inline int64_t MPIh_partition_search(int64_t n, const double prefix[n + 1], double offset, double target)
+{   /* Number of items whose cost midpoint offset + (prefix[i] + prefix[i+1]) / 2 is below target */
+    int64_t lo = 0, hi = n;
+    while (lo < hi) {
+        int64_t mid = lo + (hi - lo) / 2;
+        if (offset + 0.5 * (prefix[mid] + prefix[mid + 1]) < target) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static inline s_MPIh_range MPIh_partition_prefix(int rank, int size, int64_t N, const double prefix[N + 1])
+{   /* Weighted partition from the prefix sum of the costs: prefix[0] = 0, 
+     * prefix[i+1] = prefix[i] + cost[i]. O(log N) */
+    double total = prefix[N];
+    return (s_MPIh_range){ .begin = MPIh_partition_search(N, prefix, 0, total * rank / size),
+                           .end = rank == size - 1 ? N : MPIh_partition_search(N, prefix, 0, total * (rank + 1) / size) };
+}
+
+static inline int MPIh_partition_weighted(int rank, int size, int64_t N, const double cost[N], s_MPIh_range *out)
+{   /* Weighted partition when every rank knows all costs (>= 0). O(N). 0 if ERROR */
+    double *prefix = malloc((N + 1) * sizeof(double));
+    if (!prefix) { fprintf(stderr, "MPIh_partition_weighted: out of memory.\n"); return 0; }
+    prefix[0] = 0;
+    for (int64_t i = 0; i < N; i++) prefix[i + 1] = prefix[i] + cost[i];
+    *out = MPIh_partition_prefix(rank, size, N, prefix);
+    free(prefix);
+    return 1;
+}
+
+static inline int MPIh_repartition_weighted(int64_t nlocal, const double cost[nlocal], s_MPIh_range *out)
+{   /* Collective. Each rank holds the costs of a contiguous slice of the items, the slices 
+     * ordered by rank (e.g. from MPIh_partition_block). Computes every rank's weighted range 
+     * with one scan and one allreduce of size integers. 0 if ERROR */
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    double *prefix = malloc((nlocal + 1) * sizeof(double));
+    int64_t *counts = calloc(size + 1, sizeof(int64_t));
+    bool error = !prefix || !counts, global_error;
+    MPI_Allreduce(&error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) {
+        fprintf(stderr, "MPIh_repartition_weighted: out of memory.\n");
+        free(prefix); free(counts);
+        return 0;
+    }
+    prefix[0] = 0;
+    for (int64_t i = 0; i < nlocal; i++) prefix[i + 1] = prefix[i] + cost[i];
+    double offset = 0, total = 0;
+    MPI_Exscan(&prefix[nlocal], &offset, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) offset = 0;  /* Undefined on rank 0 */
+    MPI_Allreduce(&prefix[nlocal], &total, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    /* counts[r]: items (of all ranks) before the start of rank r */
+    for (int r = 1; r < size; r++) counts[r] = MPIh_partition_search(nlocal, prefix, offset, total * r / size);
+    counts[size] = nlocal;
+    MPI_Allreduce(MPI_IN_PLACE, counts, size + 1, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+    *out = (s_MPIh_range){ .begin = counts[rank], .end = counts[rank + 1] };
+    free(prefix); free(counts);
+    return 1;
+}
+
+/* Dynamic scheduling of [0, N) without a master rank: a shared counter lives in an RMA window
+ * on rank 0 and every rank claims chunks with an atomic MPI_Fetch_and_op. Chunks are guided:
+ * (items left) / (2 * size), never below min_chunk, so early chunks are large (few atomic 
+ * operations) and the last ones small (ranks finish together). The items left are those 
+ * seen at the previous claim, so the chunk size needs no extra communication.
+ *     s_MPIh_dynamic d;
+ *     MPIh_dynamic_init(&d, N, 16);
+ *     int64_t begin, end;
+ *     while (MPIh_dynamic_next(&d, &begin, &end)) for (i = begin; i < end; i++) ...
+ *     MPIh_dynamic_free(&d);  */
+typedef struct MPIh_dynamic {
+    MPI_Win win;
+    int64_t *counter;    /* Next unclaimed item, on rank 0 */
+    int64_t N;
+    int64_t min_chunk;
+    int64_t seen;        /* Counter value at the last claim */
+    int size;
+} s_MPIh_dynamic;
+
+static inline int MPIh_dynamic_init(s_MPIh_dynamic *d, int64_t N, int64_t min_chunk)
+{   /* Collective. 0 if ERROR */
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &d->size);
+    d->N = N;
+    d->min_chunk = min_chunk > 0 ? min_chunk : 1;
+    d->seen = 0;
+    MPI_Aint bytes = rank == 0 ? sizeof(int64_t) : 0;
+    if (MPI_Win_allocate(bytes, sizeof(int64_t), MPI_INFO_NULL, MPI_COMM_WORLD, &d->counter, &d->win) != MPI_SUCCESS) {
+        fprintf(stderr, "MPIh_dynamic_init: could not allocate the window.\n");
+        return 0;
+    }
+    if (rank == 0) *d->counter = 0;
+    MPI_Barrier(MPI_COMM_WORLD);  /* Counter initialised before anyone claims */
+    MPI_Win_lock_all(0, d->win);
+    return 1;
+}
+
+static inline bool MPIh_dynamic_next(s_MPIh_dynamic *d, int64_t *begin, int64_t *end)
+{   /* Claims the next chunk. false when all items are taken */
+    if (d->seen >= d->N) return false;
+    int64_t chunk = (d->N - d->seen) / (2 * d->size);
+    if (chunk < d->min_chunk) chunk = d->min_chunk;
+    int64_t old;
+    MPI_Fetch_and_op(&chunk, &old, MPI_INT64_T, 0, 0, MPI_SUM, d->win);
+    MPI_Win_flush(0, d->win);
+    if (old >= d->N) {
+        d->seen = d->N;
+        return false;
+    }
+    *begin = old;
+    *end = old + chunk < d->N ? old + chunk : d->N;
+    d->seen = *end;
+    return true;
+}
+
+static inline void MPIh_dynamic_reset(s_MPIh_dynamic *d)
+{   /* Collective. Hands out [0, N) again */
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Barrier(MPI_COMM_WORLD);  /* Everyone done with the previous round */
+    if (rank == 0) {
+        int64_t zero = 0, old;
+        MPI_Fetch_and_op(&zero, &old, MPI_INT64_T, 0, 0, MPI_REPLACE, d->win);
+        MPI_Win_flush(0, d->win);
+    }
+    d->seen = 0;
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+static inline void MPIh_dynamic_free(s_MPIh_dynamic *d)
+{   /* Collective */
+    MPI_Win_unlock_all(d->win);
+    MPI_Win_free(&d->win);
+}
+
+static inline double MPIh_load_imbalance(double local)
+{   /* max / mean of a per-rank quantity (e.g. busy time) over all ranks: 1 is perfect balance */
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    double max, sum;
+    MPI_Allreduce(&local, &max, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(&local, &sum, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    return sum > 0 ? max * size / sum : 1.0;
+}
+
+/* Node-shared memory. One window per node (MPI_Win_allocate_shared on a node communicator,
+ * e.g. s_MPIh_topology.node) whose memory lives on the node's rank 0; every rank of the node
+ * reads it through a direct pointer. Typical use: rank 0 of the node fills it, then all 
+ * call MPIh_shared_sync before reading. The window is kept under a passive lock_all epoch, 
+ * so MPIh_shared_sync (memory barrier + node barrier) is the only synchronisation needed. 
+ * The mapping address may differ between ranks: store offsets, not pointers, inside. */
+typedef struct MPIh_shared {
+    MPI_Win win;
+    MPI_Comm comm;
+    void *base;
+    size_t bytes;
+    bool writer;  /* Node rank 0, which owns the memory */
+} s_MPIh_shared;
+
+static inline int MPIh_shared_alloc(MPI_Comm node, size_t bytes, s_MPIh_shared *sh)
+{   /* Collective on node, bytes taken from node rank 0. 0 if ERROR */
+    int node_rank;
+    MPI_Comm_rank(node, &node_rank);
+    uint64_t n = bytes;
+    MPI_Bcast(&n, 1, MPI_UINT64_T, 0, node);
+    sh->comm = node;
+    sh->bytes = n;
+    sh->writer = node_rank == 0;
+    void *mine;
+    MPI_Aint size = sh->writer ? (MPI_Aint)(n > 0 ? n : 1) : 0;
+    if (MPI_Win_allocate_shared(size, 1, MPI_INFO_NULL, node, &mine, &sh->win) != MPI_SUCCESS) {
+        fprintf(stderr, "MPIh_shared_alloc: could not allocate %zu bytes.\n", sh->bytes);
+        return 0;
+    }
+    MPI_Aint qsize;
+    int disp;
+    MPI_Win_shared_query(sh->win, 0, &qsize, &disp, &sh->base);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, sh->win);
+    return 1;
+}
+
+static inline void MPIh_shared_sync(s_MPIh_shared *sh)
+{   /* Collective on node. Writes before the call are visible to every node rank after it */
+    MPI_Win_sync(sh->win);
+    MPI_Barrier(sh->comm);
+    MPI_Win_sync(sh->win);
+}
+
+static inline void MPIh_shared_free(s_MPIh_shared *sh)
+{   /* Collective on node */
+    MPI_Win_unlock_all(sh->win);
+    MPI_Win_free(&sh->win);
+    sh->base = NULL;
+}
+
+static inline int MPIh_shared_dynarray(MPI_Comm node, const s_dynarray *src, s_MPIh_shared *sh, s_dynarray *view)
+{   /* Collective on node. Copies src (only read on node rank 0) into a shared window; view
+     * points into it, read-only: do not push to or free view, free sh instead. 0 if ERROR */
+    int node_rank;
+    MPI_Comm_rank(node, &node_rank);
+    uint64_t shape[2] = {0, 0};
+    if (node_rank == 0) { shape[0] = src->N; shape[1] = src->item_size; }
+    MPI_Bcast(shape, 2, MPI_UINT64_T, 0, node);
+    if (!MPIh_shared_alloc(node, shape[0] * shape[1], sh)) return 0;
+    if (sh->writer && shape[0] > 0) memcpy(sh->base, src->items, shape[0] * shape[1]);
+    MPIh_shared_sync(sh);
+    *view = (s_dynarray){ .items = sh->base, .item_size = shape[1], .N = shape[0], .Nmax = shape[0] };
+    return 1;
+}
+
+/* Read-only copy of an s_hash_table in a shared window. Its linked lists hold pointers, 
+ * so it is flattened: start[nbuckets + 1] byte offsets, then the entries of each bucket 
+ * packed as [ key ][ padding ][ value ][ padding ] (same alignment as the hash arena). 
+ * Lookups use the same bucket (hash % nbuckets) as the source table. */
+typedef struct MPIh_shared_hash {
+    s_MPIh_shared mem;
+    size_t nbuckets, size;
+    size_t key_size, value_size;
+    size_t value_offset, stride;
+    const uint64_t *start;  /* Offsets from entries */
+    const char *entries;
+    f_hash_func hash;
+    f_hash_key_cmp equals;
+} s_MPIh_shared_hash;
+
+static inline int MPIh_shared_hash(MPI_Comm node, const s_hash_table *src, f_hash_func hash, f_hash_key_cmp equals, s_MPIh_shared_hash *out)
+{   /* Collective on node. src only read on node rank 0; hash and equals given by every rank
+     * (function addresses differ between processes). 0 if ERROR */
+    int node_rank;
+    MPI_Comm_rank(node, &node_rank);
+    uint64_t shape[4] = {0, 0, 0, 0};
+    if (node_rank == 0) { shape[0] = src->nbuckets; shape[1] = src->size; shape[2] = src->key_size; shape[3] = src->value_size; }
+    MPI_Bcast(shape, 4, MPI_UINT64_T, 0, node);
+    out->nbuckets = shape[0];
+    out->size = shape[1];
+    out->key_size = shape[2];
+    out->value_size = shape[3];
+    out->value_offset = align_up(out->key_size);
+    out->stride = align_up(out->value_offset + out->value_size);
+    out->hash = hash;
+    out->equals = equals;
+    size_t header = align_up((out->nbuckets + 1) * sizeof(uint64_t));
+    if (!MPIh_shared_alloc(node, header + out->size * out->stride, &out->mem)) return 0;
+    out->start = out->mem.base;
+    out->entries = (const char*)out->mem.base + header;
+
+    if (out->mem.writer) {
+        uint64_t *start = out->mem.base;
+        char *entries = (char*)out->mem.base + header;
+        uint64_t off = 0;
+        for (size_t b = 0; b < out->nbuckets; b++) {
+            start[b] = off;
+            for (s_hash_entry *e = src->buckets[b]; e; e = e->next) {
+                memcpy(entries + off, entry_key(e), out->key_size);
+                memcpy(entries + off + out->value_offset, entry_value(src, e), out->value_size);
+                off += out->stride;
+            }
+        }
+        start[out->nbuckets] = off;
+    }
+    MPIh_shared_sync(&out->mem);
+    return 1;
+}
+
+static inline const void *MPIh_shared_hash_get(const s_MPIh_shared_hash *h, const void *key)
+{   /* ptr to value if FOUND, NULL if NOT FOUND */
+    size_t b = h->hash(key) % h->nbuckets;
+    for (uint64_t off = h->start[b]; off < h->start[b + 1]; off += h->stride) {
+        if (h->equals(h->entries + off, key)) return h->entries + off + h->value_offset;
+    }
+    return NULL;
+}
+
+static inline void MPIh_shared_hash_free(s_MPIh_shared_hash *h)
+{   /* Collective on node */
+    MPIh_shared_free(&h->mem);
+}
+
+
 static inline int MPIh_malloc_parallel(size_t size, void **out)
 {
     if (!out || size <= 0) return 0;
@@ -47,6 +512,1255 @@ static inline int MPIh_malloc_parallel(size_t size, void **out)
     return 1;
 }
 
+
+typedef struct MPIh_lines {
+    char *buf;           /* Lines of this rank, '\n'-separated and null-terminated */
+    size_t len;          /* Bytes in buf, without the terminator */
+    int64_t nlines;      /* Lines owned by this rank (counted as count_lines does) */
+    int64_t first_line;  /* Global index of the first line of this rank */
+} s_MPIh_lines;
+
+#ifndef MPIH_MAX_MESSAGE
+#define MPIH_MAX_MESSAGE (1 << 30)  /* Bytes per MPI call, keeps counts far from INT_MAX */
+#endif
+
+static inline MPI_Comm MPIh_private_comm(void)
+{   /* Duplicate of MPI_COMM_WORLD for the point-to-point traffic of these helpers, so it never
+     * matches the application's messages. Collective the first time: call it where all ranks do */
+    static MPI_Comm comm = MPI_COMM_NULL;
+    if (comm == MPI_COMM_NULL) MPI_Comm_dup(MPI_COMM_WORLD, &comm);
+    return comm;
+}
+
+static inline int MPIh_post_bytes(bool send, char *buf, int64_t n, int peer, MPI_Comm comm, MPI_Request *reqs)
+{   /* Nonblocking send/recv of n bytes, in pieces of at most MPIH_MAX_MESSAGE. 
+     * Pieces share the tag, so they match in order. Returns the number of requests posted */
+    int nreqs = 0;
+    for (int64_t off = 0; off < n; off += MPIH_MAX_MESSAGE) {
+        int count = n - off < MPIH_MAX_MESSAGE ? n - off : MPIH_MAX_MESSAGE;
+        if (send) MPI_Isend(buf + off, count, MPI_BYTE, peer, 0, comm, &reqs[nreqs++]);
+        else MPI_Irecv(buf + off, count, MPI_BYTE, peer, 0, comm, &reqs[nreqs++]);
+    }
+    return nreqs;
+}
+
+static inline int MPIh_read_lines(const char *path, s_MPIh_lines *out)
+{   /* Each rank reads a contiguous byte range with MPI-IO, so the file is read once in total.
+     * A line belongs to the rank where it starts: the partial line at the front of each range 
+     * (its head) is sent to the closest previous rank that contains a line start. */
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    memset(out, 0, sizeof(*out));
+    bool local_error = false, global_error = false;
+    char *data = NULL;
+    int64_t *heads = NULL;
+    int *starts = NULL;
+    MPI_Request *reqs = NULL;
+
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0) fprintf(stderr, "MPIh_read_lines: could not open '%s'.\n", path);
+        return 0;
+    }
+    MPI_Offset file_size;
+    MPI_File_get_size(fh, &file_size);
+
+    /* Balanced byte ranges, read in pieces (same number of collective calls on every rank) */
+    int64_t rem = file_size % size;
+    int64_t begin = file_size / size * rank + (rank < rem ? rank : rem);
+    int64_t nbytes = file_size / size + (rank < rem);
+    data = malloc(nbytes + 1);
+    if (!data) local_error = true;
+
+    int64_t nreads = (nbytes + MPIH_MAX_MESSAGE - 1) / MPIH_MAX_MESSAGE, max_reads;
+    MPI_Allreduce(&nreads, &max_reads, 1, MPI_INT64_T, MPI_MAX, MPI_COMM_WORLD);
+    for (int64_t k = 0; k < max_reads; k++) {
+        int64_t off = k * MPIH_MAX_MESSAGE;
+        int count = (local_error || off >= nbytes) ? 0 : (nbytes - off < MPIH_MAX_MESSAGE ? nbytes - off : MPIH_MAX_MESSAGE);
+        if (MPI_File_read_at_all(fh, begin + off, data ? data + off : NULL, count, MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS) 
+            local_error = true;
+    }
+    MPI_File_close(&fh);
+
+    /* Head: bytes up to and including the first '\n' (all bytes if there is none). Rank 0 has none */
+    int64_t head = 0;
+    int starts_line = rank == 0;
+    if (rank > 0 && !local_error) {
+        char *nl = memchr(data, '\n', nbytes);
+        starts_line = nl != NULL;
+        head = nl ? nl - data + 1 : nbytes;
+    }
+
+    heads = malloc(size * sizeof(int64_t));
+    starts = malloc(size * sizeof(int));
+    if (!heads || !starts) local_error = true;
+    MPI_Allreduce(&local_error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) goto error;
+    MPI_Allgather(&head, 1, MPI_INT64_T, heads, 1, MPI_INT64_T, MPI_COMM_WORLD);
+    MPI_Allgather(&starts_line, 1, MPI_INT, starts, 1, MPI_INT, MPI_COMM_WORLD);
+
+    /* A rank that starts lines receives the heads of the next ranks, up to the next one that starts lines */
+    int64_t own = starts_line ? nbytes - head : 0;
+    int64_t len = own, npieces = 0;
+    int last_sender = rank;
+    for (int j = rank + 1; starts_line && j < size; j++) {
+        len += heads[j];
+        npieces += (heads[j] + MPIH_MAX_MESSAGE - 1) / MPIH_MAX_MESSAGE;
+        last_sender = j;
+        if (starts[j]) break;
+    }
+    int owner = rank - 1;
+    while (owner > 0 && !starts[owner]) owner--;
+    npieces += (head + MPIH_MAX_MESSAGE - 1) / MPIH_MAX_MESSAGE;
+
+    out->buf = malloc(len + 1);
+    reqs = malloc((npieces + 1) * sizeof(MPI_Request));
+    if (!out->buf || !reqs) local_error = true;
+    MPI_Allreduce(&local_error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) goto error;
+
+    MPI_Comm comm = MPIh_private_comm();
+    int nreqs = 0;
+    int64_t pos = own;
+    for (int j = rank + 1; j <= last_sender; j++) {
+        nreqs += MPIh_post_bytes(false, out->buf + pos, heads[j], j, comm, reqs + nreqs);
+        pos += heads[j];
+    }
+    if (rank > 0) nreqs += MPIh_post_bytes(true, data, head, owner, comm, reqs + nreqs);
+    if (own > 0) memcpy(out->buf, data + head, own);
+    MPI_Waitall(nreqs, reqs, MPI_STATUSES_IGNORE);
+    out->buf[len] = '\0';
+    out->len = len;
+
+    /* Count lines and number them globally */
+    int64_t nlines = 0;
+    for (int64_t i = 0; i < len; i++) nlines += out->buf[i] == '\n';
+    if (len > 0 && out->buf[len - 1] != '\n') nlines++;
+    out->nlines = nlines;
+    out->first_line = 0;
+    MPI_Exscan(&nlines, &out->first_line, 1, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) out->first_line = 0;  /* Exscan leaves it undefined on rank 0 */
+
+    free(data);
+    free(heads);
+    free(starts);
+    free(reqs);
+    return 1;
+
+error:
+    free(data);
+    free(heads);
+    free(starts);
+    free(reqs);
+    free(out->buf);
+    memset(out, 0, sizeof(*out));
+    return 0;
+}
+
+static inline void MPIh_lines_free(s_MPIh_lines *lines)
+{
+    if (!lines) return;
+    free(lines->buf);
+    memset(lines, 0, sizeof(*lines));
+}
+
+
+/* Collectives for messages beyond the int count limit. Counts and displacements are size_t, in 
+ * elements of type (a contiguous type, e.g. MPI_DOUBLE or MPI_BYTE); NULL displacements mean 
+ * the blocks are packed in rank order. Data moves in pieces of at most MPIH_MAX_MESSAGE bytes,
+ * all posted as nonblocking calls at once so they overlap. The v variants use point-to-point 
+ * messages on MPIh_private_comm, so byte offsets never pass through an int. 0 if ERROR on any rank. */
+static inline int MPIh_bcast_large(void *buf, size_t count, MPI_Datatype type, int root)
+{
+    int tsize;
+    MPI_Type_size(type, &tsize);
+    size_t bytes = count * tsize;
+    size_t npieces = (bytes + MPIH_MAX_MESSAGE - 1) / MPIH_MAX_MESSAGE;
+    MPI_Request *reqs = malloc((npieces + 1) * sizeof(MPI_Request));
+    bool local_error = !reqs, global_error;
+    MPI_Allreduce(&local_error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) { free(reqs); return 0; }
+    for (size_t k = 0; k < npieces; k++) {
+        size_t off = k * MPIH_MAX_MESSAGE;
+        int n = bytes - off < MPIH_MAX_MESSAGE ? bytes - off : MPIH_MAX_MESSAGE;
+        MPI_Ibcast((char*)buf + off, n, MPI_BYTE, root, MPI_COMM_WORLD, &reqs[k]);
+    }
+    MPI_Waitall(npieces, reqs, MPI_STATUSES_IGNORE);
+    free(reqs);
+    return 1;
+}
+
+static inline int MPIh_exchange_large(const char *send, const size_t sendbytes[], const size_t sdispls[],
+                                      char *recv, const size_t recvbytes[], const size_t rdispls[])
+{   /* Internal. Every rank sends sendbytes[j] from send + sdispls[j] to rank j and receives 
+     * recvbytes[j] into recv + rdispls[j] (all in bytes). Peers are visited starting from 
+     * the next rank, so not everyone targets rank 0 first */
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    int64_t npieces = 0;
+    for (int j = 0; j < size; j++) {
+        if (j == rank) continue;
+        npieces += (sendbytes[j] + MPIH_MAX_MESSAGE - 1) / MPIH_MAX_MESSAGE;
+        npieces += (recvbytes[j] + MPIH_MAX_MESSAGE - 1) / MPIH_MAX_MESSAGE;
+    }
+    MPI_Request *reqs = malloc((npieces + 1) * sizeof(MPI_Request));
+    bool local_error = !reqs, global_error;
+    MPI_Allreduce(&local_error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) { free(reqs); return 0; }
+
+    MPI_Comm comm = MPIh_private_comm();
+    int nreqs = 0;
+    for (int k = 1; k < size; k++) {
+        int j = (rank - k + size) % size;
+        nreqs += MPIh_post_bytes(false, recv + rdispls[j], recvbytes[j], j, comm, reqs + nreqs);
+    }
+    for (int k = 1; k < size; k++) {
+        int j = (rank + k) % size;
+        nreqs += MPIh_post_bytes(true, (char*)send + sdispls[j], sendbytes[j], j, comm, reqs + nreqs);
+    }
+    if (recvbytes[rank] > 0) memcpy(recv + rdispls[rank], send + sdispls[rank], recvbytes[rank]);
+    MPI_Waitall(nreqs, reqs, MPI_STATUSES_IGNORE);
+    free(reqs);
+    return 1;
+}
+
+static inline int MPIh_allgatherv_large(const void *send, size_t count, void *recv, const size_t counts[], 
+                                        const size_t displs[], MPI_Datatype type)
+{   /* Rank j's count elements land at recv + displs[j] on every rank, counts[j] == its count */
+    int rank, size, tsize;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MPI_Type_size(type, &tsize);
+    size_t *b = malloc(4 * size * sizeof(size_t));
+    bool local_error = !b, global_error;
+    MPI_Allreduce(&local_error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) { free(b); return 0; }
+    size_t *sendbytes = b, *sdispls = b + size, *recvbytes = b + 2 * size, *rdispls = b + 3 * size;
+    size_t pos = 0;
+    for (int j = 0; j < size; j++) {
+        sendbytes[j] = count * tsize;
+        sdispls[j] = 0;
+        recvbytes[j] = counts[j] * tsize;
+        rdispls[j] = displs ? displs[j] * tsize : pos;
+        pos += recvbytes[j];
+    }
+    int out = MPIh_exchange_large(send, sendbytes, sdispls, recv, recvbytes, rdispls);
+    free(b);
+    return out;
+}
+
+static inline int MPIh_alltoallv_large(const void *send, const size_t sendcounts[], const size_t sdispls[],
+                                       void *recv, const size_t recvcounts[], const size_t rdispls[], MPI_Datatype type)
+{   /* sendcounts[j] elements from send + sdispls[j] go to rank j, which receives them at recv + rdispls[rank] */
+    int size, tsize;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MPI_Type_size(type, &tsize);
+    size_t *b = malloc(4 * size * sizeof(size_t));
+    bool local_error = !b, global_error;
+    MPI_Allreduce(&local_error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) { free(b); return 0; }
+    size_t *sb = b, *sd = b + size, *rb = b + 2 * size, *rd = b + 3 * size;
+    size_t spos = 0, rpos = 0;
+    for (int j = 0; j < size; j++) {
+        sb[j] = sendcounts[j] * tsize;
+        sd[j] = sdispls ? sdispls[j] * tsize : spos;
+        rb[j] = recvcounts[j] * tsize;
+        rd[j] = rdispls ? rdispls[j] * tsize : rpos;
+        spos += sb[j];
+        rpos += rb[j];
+    }
+    int out = MPIh_exchange_large(send, sb, sd, recv, rb, rd);
+    free(b);
+    return out;
+}
+
+
+/* Halo exchange for domain-decomposed arrays. Per neighbour, the indices (into the local array
+ * of items) to send and the indices where its items are received, registered once. Messages use 
+ * persistent requests (MPI_Send_init / MPI_Recv_init) on packed buffers, so an exchange is:
+ *     MPIh_halo_start(&h, data);   // Packs and starts
+ *     ... compute on interior items ...
+ *     MPIh_halo_wait(&h, data);    // Completes and unpacks into the halo items
+ *     ... compute on boundary items ...
+ * Index lists are concatenated over neighbours, with nsend[k] / nrecv[k] entries for peers[k].
+ * A neighbour must register as many receives from us as we send to it, and each peer appears
+ * once (messages between a pair match in order, so merge the lists of repeated peers). */
+typedef struct MPIh_halo {
+    int nneighbours;
+    size_t item_size;
+    int64_t *send_idx, *send_off;  /* send_off[k]: first index of neighbour k, nneighbours + 1 */
+    int64_t *recv_idx, *recv_off;
+    char *send_buf, *recv_buf;
+    MPI_Request *reqs;             /* Receives first, then sends */
+    bool active;
+} s_MPIh_halo;
+
+static inline void MPIh_halo_gather(char *restrict dst, const char *restrict src, const int64_t *restrict idx, int64_t n, size_t item_size)
+{   /* dst[i] = src[idx[i]]. 4 and 8-byte items as typed loops, which vectorise as gathers */
+    if (item_size == 8) {
+        uint64_t *d = (uint64_t*)dst;
+        const uint64_t *s = (const uint64_t*)src;
+        for (int64_t i = 0; i < n; i++) d[i] = s[idx[i]];
+    } else if (item_size == 4) {
+        uint32_t *d = (uint32_t*)dst;
+        const uint32_t *s = (const uint32_t*)src;
+        for (int64_t i = 0; i < n; i++) d[i] = s[idx[i]];
+    } else {
+        for (int64_t i = 0; i < n; i++) memcpy(dst + i * item_size, src + idx[i] * item_size, item_size);
+    }
+}
+
+static inline void MPIh_halo_scatter(char *restrict dst, const char *restrict src, const int64_t *restrict idx, int64_t n, size_t item_size)
+{   /* dst[idx[i]] = src[i] */
+    if (item_size == 8) {
+        uint64_t *d = (uint64_t*)dst;
+        const uint64_t *s = (const uint64_t*)src;
+        for (int64_t i = 0; i < n; i++) d[idx[i]] = s[i];
+    } else if (item_size == 4) {
+        uint32_t *d = (uint32_t*)dst;
+        const uint32_t *s = (const uint32_t*)src;
+        for (int64_t i = 0; i < n; i++) d[idx[i]] = s[i];
+    } else {
+        for (int64_t i = 0; i < n; i++) memcpy(dst + idx[i] * item_size, src + i * item_size, item_size);
+    }
+}
+
+static inline int MPIh_halo_init(s_MPIh_halo *h, size_t item_size, int nneighbours, const int peers[nneighbours],
+                                 const int64_t nsend[nneighbours], const int64_t *send_idx,
+                                 const int64_t nrecv[nneighbours], const int64_t *recv_idx, int tag)
+{   /* Local (not collective). 0 if ERROR */
+    memset(h, 0, sizeof(*h));
+    h->nneighbours = nneighbours;
+    h->item_size = item_size;
+    h->send_off = malloc((nneighbours + 1) * sizeof(int64_t));
+    h->recv_off = malloc((nneighbours + 1) * sizeof(int64_t));
+    h->reqs = malloc((2 * nneighbours + 1) * sizeof(MPI_Request));
+    if (!h->send_off || !h->recv_off || !h->reqs) goto error;
+    h->send_off[0] = h->recv_off[0] = 0;
+    for (int k = 0; k < nneighbours; k++) {
+        if ((nsend[k] > nrecv[k] ? nsend[k] : nrecv[k]) * item_size > INT32_MAX) {
+            fprintf(stderr, "MPIh_halo_init: halo with rank %d is larger than 2 GB.\n", peers[k]);
+            goto error;
+        }
+        h->send_off[k + 1] = h->send_off[k] + nsend[k];
+        h->recv_off[k + 1] = h->recv_off[k] + nrecv[k];
+    }
+    int64_t ns = h->send_off[nneighbours], nr = h->recv_off[nneighbours];
+    h->send_idx = malloc((ns + 1) * sizeof(int64_t));
+    h->recv_idx = malloc((nr + 1) * sizeof(int64_t));
+    h->send_buf = malloc(ns * item_size + 1);
+    h->recv_buf = malloc(nr * item_size + 1);
+    if (!h->send_idx || !h->recv_idx || !h->send_buf || !h->recv_buf) goto error;
+    memcpy(h->send_idx, send_idx, ns * sizeof(int64_t));
+    memcpy(h->recv_idx, recv_idx, nr * sizeof(int64_t));
+
+    for (int k = 0; k < nneighbours; k++) {
+        MPI_Recv_init(h->recv_buf + h->recv_off[k] * item_size, nrecv[k] * item_size, MPI_BYTE, 
+                      peers[k], tag, MPI_COMM_WORLD, &h->reqs[k]);
+        MPI_Send_init(h->send_buf + h->send_off[k] * item_size, nsend[k] * item_size, MPI_BYTE, 
+                      peers[k], tag, MPI_COMM_WORLD, &h->reqs[nneighbours + k]);
+    }
+    return 1;
+
+error:
+    free(h->send_off); free(h->recv_off); free(h->reqs);
+    free(h->send_idx); free(h->recv_idx); free(h->send_buf); free(h->recv_buf);
+    memset(h, 0, sizeof(*h));
+    return 0;
+}
+
+static inline void MPIh_halo_start(s_MPIh_halo *h, const void *data)
+{
+    int n = h->nneighbours;
+    MPI_Startall(n, h->reqs);  /* Receives posted before packing */
+    MPIh_halo_gather(h->send_buf, data, h->send_idx, h->send_off[n], h->item_size);
+    MPI_Startall(n, h->reqs + n);
+    h->active = true;
+}
+
+static inline void MPIh_halo_wait(s_MPIh_halo *h, void *data)
+{
+    if (!h->active) return;
+    int n = h->nneighbours;
+    MPI_Waitall(2 * n, h->reqs, MPI_STATUSES_IGNORE);
+    MPIh_halo_scatter(data, h->recv_buf, h->recv_idx, h->recv_off[n], h->item_size);
+    h->active = false;
+}
+
+static inline void MPIh_halo_exchange(s_MPIh_halo *h, void *data)
+{   /* Blocking exchange, no overlap */
+    MPIh_halo_start(h, data);
+    MPIh_halo_wait(h, data);
+}
+
+static inline void MPIh_halo_free(s_MPIh_halo *h)
+{
+    if (h->active) MPI_Waitall(2 * h->nneighbours, h->reqs, MPI_STATUSES_IGNORE);
+    for (int k = 0; k < 2 * h->nneighbours; k++) MPI_Request_free(&h->reqs[k]);
+    free(h->send_off); free(h->recv_off); free(h->reqs);
+    free(h->send_idx); free(h->recv_idx); free(h->send_buf); free(h->recv_buf);
+    memset(h, 0, sizeof(*h));
+}
+
+
+/* Distributed sample sort of 64-bit keys with a 64-bit payload (e.g. the item's global index).
+ * 1. Local LSD radix sort (8-bit digits, digits equal in every key are skipped, OpenMP 
+ *    threads histogram and scatter their own chunks). 
+ * 2. Regular sampling: every rank takes size evenly spaced samples, all are gathered and 
+ *    sorted, and size - 1 of them are the splitters. 
+ * 3. Items are sent to their bucket's rank (MPIh_alltoallv_large) and radix sorted again.
+ * 4. Balance: items are shifted between neighbouring ranks to the MPIh_partition_block ranges
+ *    of the global count, so rank r ends with the r-th block of the sorted sequence.
+ * Ties are ordered by (key, source rank, position in the locally sorted array), a total order, so splitters also split runs
+ * of equal keys and the result does not depend on timing. The radix sort is stable, so equal 
+ * keys keep that order. */
+typedef struct MPIh_kv {
+    uint64_t key;
+    uint64_t value;
+} s_MPIh_kv;
+
+static inline void MPIh_radix_sort(s_MPIh_kv *a, s_MPIh_kv *tmp, int64_t n)
+{   /* Stable sort of a by key, tmp is scratch of n items */
+    int nthreads = 1;
+#ifdef _OPENMP
+    if (n >= (1 << 16)) nthreads = omp_get_max_threads();
+#endif
+    int64_t one[1][256];
+    int64_t (*hist)[256] = nthreads > 1 ? malloc(nthreads * sizeof(*hist)) : one;
+    if (!hist) { hist = one; nthreads = 1; }
+    s_MPIh_kv *src = a, *dst = tmp;
+    for (int shift = 0; shift < 64; shift += 8) {
+        bool skip = false;
+#ifdef _OPENMP
+        #pragma omp parallel num_threads(nthreads)
+#endif
+        {
+            int t = 0, nt = 1;
+#ifdef _OPENMP
+            t = omp_get_thread_num();
+            nt = omp_get_num_threads();
+#endif
+            int64_t begin = n * t / nt, end = n * (t + 1) / nt;
+            int64_t *h = hist[t];
+            memset(h, 0, sizeof(*hist));
+            for (int64_t i = begin; i < end; i++) h[(src[i].key >> shift) & 255]++;
+#ifdef _OPENMP
+            #pragma omp barrier
+            #pragma omp single
+#endif
+            {   /* Exclusive prefix over (digit, thread) */
+                int64_t pos = 0;
+                for (int d = 0; d < 256; d++) {
+                    int64_t total = 0;
+                    for (int u = 0; u < nt; u++) {
+                        int64_t c = hist[u][d];
+                        hist[u][d] = pos;
+                        pos += c;
+                        total += c;
+                    }
+                    if (total == n) skip = true;  /* Digit equal in every key */
+                }
+            }
+            if (!skip) {
+                for (int64_t i = begin; i < end; i++) dst[h[(src[i].key >> shift) & 255]++] = src[i];
+            }
+        }
+        if (!skip) { s_MPIh_kv *s = src; src = dst; dst = s; }
+    }
+    if (src != a) memcpy(a, src, n * sizeof(s_MPIh_kv));
+    if (hist != one) free(hist);
+}
+
+static inline int MPIh_sort_sample_cmp(const void *a, const void *b)
+{   /* Samples are (key, rank, position) */
+    const uint64_t *x = a, *y = b;
+    for (int k = 0; k < 3; k++) if (x[k] != y[k]) return x[k] < y[k] ? -1 : 1;
+    return 0;
+}
+
+static inline int64_t MPIh_sort_count_le(const s_MPIh_kv *a, int64_t n, int rank, const uint64_t split[3])
+{   /* Items of this rank (sorted by key) not after split in (key, rank, position) order */
+    if ((uint64_t)rank == split[1]) return split[2] + 1;  /* The splitter is our item */
+    bool after = (uint64_t)rank < split[1];  /* Our equal keys go before the splitter */
+    int64_t lo = 0, hi = n;  /* First key > split key (after) or >= split key */
+    while (lo < hi) { 
+        int64_t mid = lo + (hi - lo) / 2; 
+        if (a[mid].key < split[0] || (after && a[mid].key == split[0])) lo = mid + 1; 
+        else hi = mid; 
+    }
+    return lo;
+}
+
+static inline int MPIh_sample_sort(const s_MPIh_kv *local, int64_t n, s_MPIh_kv **out, int64_t *nout)
+{   /* Collective. *out (malloc'd, free by the user) gets this rank's block of the globally sorted
+     * items. 0 if ERROR */
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    *out = NULL;
+    *nout = 0;
+    s_MPIh_kv *a = malloc((n + 1) * sizeof(s_MPIh_kv)), *tmp = malloc((n + 1) * sizeof(s_MPIh_kv));
+    s_MPIh_kv *recv = NULL, *res = NULL;
+    uint64_t *samples = NULL, *all = NULL;
+    size_t *counts = malloc(6 * size * sizeof(size_t));
+    int *nsamples = malloc(2 * size * sizeof(int));
+    int64_t *nitems = malloc(size * sizeof(int64_t));
+    samples = malloc((3 * size + 1) * sizeof(uint64_t));
+    all = malloc((3 * (size_t)size * size + 1) * sizeof(uint64_t));
+    bool local_error = !a || !tmp || !counts || !nsamples || !nitems || !samples || !all, global_error;
+    MPI_Allreduce(&local_error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) goto error;
+    size_t *sendc = counts, *recvc = counts + size;
+    int *displs = nsamples + size;
+
+    memcpy(a, local, n * sizeof(s_MPIh_kv));
+    MPIh_radix_sort(a, tmp, n);
+
+    /* Regular samples and splitters */
+    int ns = n < size ? n : size;
+    for (int k = 0; k < ns; k++) {
+        int64_t i = (2 * k + 1) * n / (2 * ns);
+        samples[3 * k] = a[i].key;
+        samples[3 * k + 1] = rank;
+        samples[3 * k + 2] = i;
+    }
+    ns *= 3;
+    MPI_Allgather(&ns, 1, MPI_INT, nsamples, 1, MPI_INT, MPI_COMM_WORLD);
+    int m = 0;
+    for (int j = 0; j < size; j++) { displs[j] = m; m += nsamples[j]; }
+    MPI_Allgatherv(samples, ns, MPI_UINT64_T, all, nsamples, displs, MPI_UINT64_T, MPI_COMM_WORLD);
+    m /= 3;
+    qsort(all, m, 3 * sizeof(uint64_t), MPIh_sort_sample_cmp);
+
+    /* Bucket j: after splitter j - 1, up to splitter j */
+    int64_t prev = 0;
+    for (int j = 0; j < size; j++) {
+        int64_t upto = n;  /* m == 0 only if there are no items at all */
+        if (j < size - 1 && m > 0) upto = MPIh_sort_count_le(a, n, rank, all + 3 * ((int64_t)(j + 1) * m / size));
+        sendc[j] = 2 * (upto - prev);  /* In uint64 */
+        prev = upto;
+    }
+    MPI_Alltoall(sendc, 1, MPI_UINT64_T, recvc, 1, MPI_UINT64_T, MPI_COMM_WORLD);
+    int64_t nrecv = 0;
+    for (int j = 0; j < size; j++) nrecv += recvc[j] / 2;
+    recv = malloc((nrecv + 1) * sizeof(s_MPIh_kv));
+    free(tmp);
+    tmp = malloc((nrecv + 1) * sizeof(s_MPIh_kv));
+    local_error = !recv || !tmp;
+    MPI_Allreduce(&local_error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) goto error;
+    if (!MPIh_alltoallv_large(a, sendc, NULL, recv, recvc, NULL, MPI_UINT64_T)) goto error;
+    free(a);
+    a = NULL;
+    MPIh_radix_sort(recv, tmp, nrecv);  /* Runs arrive by source rank, stability keeps the tie order */
+
+    /* Shift to the block partition: this rank holds global positions [first, first + nrecv) */
+    MPI_Allgather(&nrecv, 1, MPI_INT64_T, nitems, 1, MPI_INT64_T, MPI_COMM_WORLD);
+    int64_t N = 0, first = 0;
+    for (int j = 0; j < size; j++) { if (j < rank) first += nitems[j]; N += nitems[j]; }
+    s_MPIh_range mine = MPIh_partition_block(rank, size, N);
+    int64_t src_begin = 0;
+    for (int j = 0; j < size; j++) {
+        s_MPIh_range r = MPIh_partition_block(j, size, N);
+        int64_t lo = first > r.begin ? first : r.begin, hi = first + nrecv < r.end ? first + nrecv : r.end;
+        sendc[j] = hi > lo ? 2 * (hi - lo) : 0;
+        lo = src_begin > mine.begin ? src_begin : mine.begin;
+        hi = src_begin + nitems[j] < mine.end ? src_begin + nitems[j] : mine.end;
+        recvc[j] = hi > lo ? 2 * (hi - lo) : 0;
+        src_begin += nitems[j];
+    }
+    res = malloc((mine.end - mine.begin + 1) * sizeof(s_MPIh_kv));
+    local_error = !res;
+    MPI_Allreduce(&local_error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) goto error;
+    if (!MPIh_alltoallv_large(recv, sendc, NULL, res, recvc, NULL, MPI_UINT64_T)) goto error;
+
+    free(tmp); free(recv); free(counts); free(nsamples); free(nitems); free(samples); free(all);
+    *out = res;
+    *nout = mine.end - mine.begin;
+    return 1;
+
+error:
+    if (rank == 0) fprintf(stderr, "MPIh_sample_sort: could not allocate.\n");
+    free(a); free(tmp); free(recv); free(res); free(counts); free(nsamples); free(nitems); free(samples); free(all);
+    return 0;
+}
+
+
+
+/* Reductions of s_sample and s_moments (stats.h). MPIh_sample_type and MPIh_sample_merge_op (and the 
+ * s_moments counterparts) can be used directly, e.g. MPI_Allreduce(MPI_IN_PLACE, samples, n, MPIh_sample_type(), MPIh_sample_merge_op(), comm).
+ * The op is declared non-commutative, so MPI combines in rank order. Both are created on 
+ * first use and released by MPI_Finalize. */
+static inline void MPIh_sample_merge(void *in, void *inout, int *len, MPI_Datatype *type)
+{
+    (void)type;
+    const s_sample *a = in;
+    s_sample *b = inout;
+    for (int i = 0; i < *len; i++) b[i] = stats_merge_samples(a[i], b[i]);
+}
+
+static inline MPI_Datatype MPIh_sample_type(void)
+{
+    static MPI_Datatype type = MPI_DATATYPE_NULL;
+    if (type == MPI_DATATYPE_NULL) {
+        int blocklengths[2] = {1, 2};
+        MPI_Aint displacements[2] = { offsetof(s_sample, N), offsetof(s_sample, mu) };
+        MPI_Datatype types[2] = { MPI_INT64_T, MPI_DOUBLE };
+        MPI_Datatype tmp;
+        MPI_Type_create_struct(2, blocklengths, displacements, types, &tmp);
+        MPI_Type_create_resized(tmp, 0, sizeof(s_sample), &type);
+        MPI_Type_free(&tmp);
+        MPI_Type_commit(&type);
+    }
+    return type;
+}
+
+static inline MPI_Op MPIh_sample_merge_op(void)
+{
+    static MPI_Op op = MPI_OP_NULL;
+    if (op == MPI_OP_NULL) MPI_Op_create(MPIh_sample_merge, 0, &op);
+    return op;
+}
+
+static inline void MPIh_moments_merge(void *in, void *inout, int *len, MPI_Datatype *type)
+{
+    (void)type;
+    const s_moments *a = in;
+    s_moments *b = inout;
+    for (int i = 0; i < *len; i++) b[i] = stats_merge_moments(a[i], b[i]);
+}
+
+static inline MPI_Datatype MPIh_moments_type(void)
+{
+    static MPI_Datatype type = MPI_DATATYPE_NULL;
+    if (type == MPI_DATATYPE_NULL) {
+        int blocklengths[2] = {1, 6};
+        MPI_Aint displacements[2] = { offsetof(s_moments, N), offsetof(s_moments, W) };
+        MPI_Datatype types[2] = { MPI_INT64_T, MPI_DOUBLE };
+        MPI_Datatype tmp;
+        MPI_Type_create_struct(2, blocklengths, displacements, types, &tmp);
+        MPI_Type_create_resized(tmp, 0, sizeof(s_moments), &type);
+        MPI_Type_free(&tmp);
+        MPI_Type_commit(&type);
+    }
+    return type;
+}
+
+static inline MPI_Op MPIh_moments_merge_op(void)
+{
+    static MPI_Op op = MPI_OP_NULL;
+    if (op == MPI_OP_NULL) MPI_Op_create(MPIh_moments_merge, 0, &op);
+    return op;
+}
+
+static inline int MPIh_allreduce_sample(s_sample *sample)
+{   /* Replaces sample on every rank by the merge of all ranks' samples, with stats_merge_tree in 
+     * rank order, so all ranks get bitwise identical results, independent of the MPI implementation.
+     * 0 if ERROR (sample is left unchanged) */
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    s_sample *all = malloc(size * sizeof(s_sample));
+    bool error = !all, global_error;
+    MPI_Allreduce(&error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) {
+        fprintf(stderr, "MPIh_allreduce_sample: out of memory.\n");
+        free(all);
+        return 0;
+    }
+    MPI_Allgather(sample, 1, MPIh_sample_type(), all, 1, MPIh_sample_type(), MPI_COMM_WORLD);
+    *sample = stats_merge_tree(size, all);
+    free(all);
+    return 1;
+}
+
+static inline int MPIh_allreduce_tdigest(s_tdigest *td)
+{   /* Replaces td on every rank by the merge of all ranks' digests, taken in rank order so 
+     * all ranks end up with the same centroids. 0 if ERROR (td is left unchanged) */
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    int local_size = stats_tdigest_serialized_size(td);
+    int *sizes = malloc(size * sizeof(int));
+    int *displs = malloc(size * sizeof(int));
+    void *local = malloc(local_size);
+    bool error = !sizes || !displs || !local;
+    bool global_error;
+    MPI_Allreduce(&error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) {
+        fprintf(stderr, "MPIh_allreduce_tdigest: out of memory.\n");
+        free(sizes); free(displs); free(local);
+        return 0;
+    }
+    stats_tdigest_serialize(td, local);
+    MPI_Allgather(&local_size, 1, MPI_INT, sizes, 1, MPI_INT, MPI_COMM_WORLD);
+    int total = 0;
+    for (int i = 0; i < size; i++) { displs[i] = total; total += sizes[i]; }
+
+    char *all = malloc(total);
+    s_tdigest out;
+    error = !all || !stats_tdigest_init(&out, td->compression);
+    MPI_Allreduce(&error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) {
+        fprintf(stderr, "MPIh_allreduce_tdigest: out of memory.\n");
+        if (all && !error) stats_tdigest_free(&out);
+        free(all); free(sizes); free(displs); free(local);
+        return 0;
+    }
+    MPI_Allgatherv(local, local_size, MPI_BYTE, all, sizes, displs, MPI_BYTE, MPI_COMM_WORLD);
+    for (int i = 0; i < size; i++) stats_tdigest_merge_serialized(&out, all + displs[i], sizes[i]);
+    stats_tdigest_compress(&out);
+
+    stats_tdigest_free(td);
+    *td = out;
+    free(all); free(sizes); free(displs); free(local);
+    return 1;
+}
+
+static inline void MPIh_allreduce_hdr(s_hdr_histogram *h)
+{   /* Sums the counts of h over all ranks, which must all use the same configuration */
+    MPI_Allreduce(MPI_IN_PLACE, h->counts, (int)h->counts_len, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &h->total_count, 1, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+}
+
+static inline int MPIh_allreduce_multisample(s_multisample *s)
+{   /* Replaces s on every rank by the merge of all ranks' accumulators, in rank order. All 
+     * ranks must use the same d. 0 if ERROR (s is left unchanged) */
+    int size, d = s->d;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    size_t stride = d + (size_t)d * d;
+    int64_t *N = malloc(size * sizeof(int64_t));
+    double *local = malloc(stride * sizeof(double));
+    double *all = malloc(size * stride * sizeof(double));
+    bool error = !N || !local || !all || stride > INT32_MAX;
+    bool global_error;
+    MPI_Allreduce(&error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) {
+        fprintf(stderr, "MPIh_allreduce_multisample: out of memory.\n");
+        free(N); free(local); free(all);
+        return 0;
+    }
+    memcpy(local, s->mu, d * sizeof(double));
+    memcpy(local + d, s->C, (size_t)d * d * sizeof(double));
+    MPI_Allgather(&s->N, 1, MPI_INT64_T, N, 1, MPI_INT64_T, MPI_COMM_WORLD);
+    MPI_Allgather(local, (int)stride, MPI_DOUBLE, all, (int)stride, MPI_DOUBLE, MPI_COMM_WORLD);
+
+    s->N = 0;
+    memset(s->mu, 0, d * sizeof(double));
+    memset(s->C, 0, (size_t)d * d * sizeof(double));
+    for (int r = 0; r < size; r++) stats_multi_merge_parts(s, N[r], all + r * stride, all + r * stride + d);
+    free(N); free(local); free(all);
+    return 1;
+}
+
+static inline int MPIh_allreduce_hll(s_hll *h)
+{   /* Merges h over all ranks (same precision everywhere). h becomes dense. 0 if ERROR */
+    bool error = !stats_hll_to_dense(h);
+    bool global_error;
+    MPI_Allreduce(&error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) return 0;
+    MPI_Allreduce(MPI_IN_PLACE, h->registers, 1 << h->p, MPI_UINT8_T, MPI_MAX, MPI_COMM_WORLD);
+    return 1;
+}
+
+static inline int MPIh_allreduce_sketch(s_count_sketch *s)
+{   /* Sums the counters over all ranks (same type and dimensions everywhere) and rebuilds the 
+     * top k from every rank's candidates. 0 if ERROR */
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    uint64_t *keys = malloc((size_t)size * (s->k + 1) * sizeof(uint64_t));
+    int *nkeys = malloc(size * sizeof(int));
+    int *displs = malloc(size * sizeof(int));
+    bool error = !keys || !nkeys || !displs || (size_t)s->width * s->depth > INT32_MAX;
+    bool global_error;
+    MPI_Allreduce(&error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) {
+        fprintf(stderr, "MPIh_allreduce_sketch: out of memory.\n");
+        free(keys); free(nkeys); free(displs);
+        return 0;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, s->counters, s->width * s->depth, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &s->total, 1, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+
+    MPI_Allgather(&s->ntop, 1, MPI_INT, nkeys, 1, MPI_INT, MPI_COMM_WORLD);
+    int total = 0;
+    for (int r = 0; r < size; r++) { displs[r] = total; total += nkeys[r]; }
+    MPI_Allgatherv(s->top_keys, s->ntop, MPI_UINT64_T, keys, nkeys, displs, MPI_UINT64_T, MPI_COMM_WORLD);
+    s->ntop = 0;
+    stats_sketch_refresh_top(s, total, keys);
+    free(keys); free(nkeys); free(displs);
+    return 1;
+}
+
+
+/* Communication profile through the PMPI interface. Define MPIH_PROFILE_IMPLEMENTATION before
+ * including this header in exactly ONE translation unit of the program: it then defines 
+ * MPI_Send, MPI_Allreduce, ... (overriding the library's, which stay reachable as PMPI_*), 
+ * recording calls, bytes and time per function and per communicator. At MPI_Finalize, rank 0 
+ * prints min / mean / max over ranks and max / mean (load imbalance) to stderr. Without the 
+ * macro nothing is compiled, so there is no overhead. Bytes are those of the posted buffers 
+ * (send side for collectives); time is spent inside the call (waits for nonblocking ones).
+ * Counters are not atomic: with MPI_THREAD_MULTIPLE, concurrent calls may be miscounted.
+ * Communicators made by MPI_Comm_dup, _split, _split_type or _create are numbered by their
+ * rank 0 when created (one extra broadcast on the new communicator) and tagged with an 
+ * attribute, so each one is reported apart, also if its handle is freed and reused, with 
+ * min / mean / max over its members only. Others (e.g. intercommunicators) are identified by 
+ * (world rank of their rank 0, size), so several of them may be reported together. */
+#ifdef MPIH_PROFILE_IMPLEMENTATION
+#ifdef HLIBS_MPI_STUB
+#error "MPIH_PROFILE_IMPLEMENTATION needs a real MPI library (PMPI), not HLIBS_MPI_STUB"
+#endif
+
+typedef enum MPIh_prof_func {
+    MPIH_PROF_SEND, MPIH_PROF_RECV, MPIH_PROF_ISEND, MPIH_PROF_IRECV, MPIH_PROF_SENDRECV,
+    MPIH_PROF_WAIT, MPIH_PROF_WAITALL, MPIH_PROF_STARTALL, MPIH_PROF_BARRIER, MPIH_PROF_BCAST,
+    MPIH_PROF_IBCAST, MPIH_PROF_REDUCE, MPIH_PROF_ALLREDUCE, MPIH_PROF_GATHER, MPIH_PROF_ALLGATHER, 
+    MPIH_PROF_ALLGATHERV, MPIH_PROF_ALLTOALL, MPIH_PROF_ALLTOALLV, MPIH_PROF_EXSCAN, 
+    MPIH_PROF_FETCH_AND_OP, MPIH_PROF_N
+} e_MPIh_prof_func;
+
+static const char *MPIh_prof_names[MPIH_PROF_N] = {
+    "MPI_Send", "MPI_Recv", "MPI_Isend", "MPI_Irecv", "MPI_Sendrecv", 
+    "MPI_Wait", "MPI_Waitall", "MPI_Startall", "MPI_Barrier", "MPI_Bcast",
+    "MPI_Ibcast", "MPI_Reduce", "MPI_Allreduce", "MPI_Gather", "MPI_Allgather",
+    "MPI_Allgatherv", "MPI_Alltoall", "MPI_Alltoallv", "MPI_Exscan",
+    "MPI_Fetch_and_op"
+};
+
+typedef struct MPIh_prof_counter {
+    double calls, bytes, time;
+} s_MPIh_prof_counter;
+
+typedef struct MPIh_prof_comm {  /* Identity across ranks: world rank of its rank 0 (-2 for MPI_COMM_WORLD), */
+    double leader, seq, size;    /* number given by that rank at creation (-1 if unknown) and size */
+    s_MPIh_prof_counter c;
+} s_MPIh_prof_comm;
+
+static struct {
+    double t0;
+    s_MPIh_prof_counter f[MPIH_PROF_N];
+    s_MPIh_prof_comm *comms;  /* Every communicator this rank belonged to, freed ones included */
+    int ncomms, capacity;
+    int keyval;               /* Communicator attribute: index in comms + 1 */
+    bool ready;
+    int created;              /* Communicators created with this rank as their rank 0 */
+} MPIh_prof;
+
+static inline double MPIh_prof_bytes(int count, MPI_Datatype type)
+{
+    int size;
+    PMPI_Type_size(type, &size);
+    return (double)count * size;
+}
+
+static inline int MPIh_prof_leader(MPI_Comm comm)
+{   /* World rank of rank 0 of comm (of its local group, for intercommunicators) */
+    MPI_Group group, world;
+    int zero = 0, leader;
+    PMPI_Comm_group(comm, &group);
+    PMPI_Comm_group(MPI_COMM_WORLD, &world);
+    PMPI_Group_translate_ranks(group, 1, &zero, world, &leader);
+    PMPI_Group_free(&group);
+    PMPI_Group_free(&world);
+    return leader;
+}
+
+static inline int MPIh_prof_attach(MPI_Comm comm, double leader, double seq)
+{   /* New entry for comm, tagged on it. Index, -1 if out of memory */
+    if (MPIh_prof.ncomms == MPIh_prof.capacity) {
+        int capacity = MPIh_prof.capacity ? 2 * MPIh_prof.capacity : 16;
+        s_MPIh_prof_comm *comms = realloc(MPIh_prof.comms, capacity * sizeof(s_MPIh_prof_comm));
+        if (!comms) return -1;
+        MPIh_prof.comms = comms;
+        MPIh_prof.capacity = capacity;
+    }
+    int size, k = MPIh_prof.ncomms++;
+    PMPI_Comm_size(comm, &size);
+    MPIh_prof.comms[k] = (s_MPIh_prof_comm){ .leader = leader, .seq = seq, .size = size };
+    PMPI_Comm_set_attr(comm, MPIh_prof.keyval, (void*)(intptr_t)(k + 1));
+    return k;
+}
+
+static inline void MPIh_prof_start(void)
+{   /* After PMPI_Init* */
+    MPIh_prof.t0 = PMPI_Wtime();
+    if (PMPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, MPI_COMM_NULL_DELETE_FN, &MPIh_prof.keyval, NULL) != MPI_SUCCESS) return;
+    MPIh_prof.ready = true;
+    MPIh_prof_attach(MPI_COMM_WORLD, -2, 0);  /* Not confused with its duplicates */
+}
+
+static inline void MPIh_prof_created(MPI_Comm comm)
+{   /* Collective on a new communicator: its rank 0 numbers it, every member adds the entry */
+    int inter;
+    if (!MPIh_prof.ready || comm == MPI_COMM_NULL) return;
+    PMPI_Comm_test_inter(comm, &inter);
+    if (inter) return;  /* Identified on first use */
+    int rank, seq = 0;
+    PMPI_Comm_rank(comm, &rank);
+    if (rank == 0) seq = MPIh_prof.created++;
+    PMPI_Bcast(&seq, 1, MPI_INT, 0, comm);
+    MPIh_prof_attach(comm, MPIh_prof_leader(comm), seq);
+}
+
+static inline void MPIh_prof_record(e_MPIh_prof_func f, MPI_Comm comm, double bytes, double t0)
+{   /* comm MPI_COMM_NULL if unknown (waits) */
+    double t = PMPI_Wtime() - t0;
+    MPIh_prof.f[f].calls++;
+    MPIh_prof.f[f].bytes += bytes;
+    MPIh_prof.f[f].time += t;
+    if (comm == MPI_COMM_NULL || !MPIh_prof.ready) return;
+    void *attr;
+    int flag, k;
+    PMPI_Comm_get_attr(comm, MPIh_prof.keyval, &attr, &flag);
+    if (flag) k = (int)(intptr_t)attr - 1;
+    else k = MPIh_prof_attach(comm, MPIh_prof_leader(comm), -1);  /* Not made by a wrapped call */
+    if (k < 0) return;
+    MPIh_prof.comms[k].c.calls++;
+    MPIh_prof.comms[k].c.bytes += bytes;
+    MPIh_prof.comms[k].c.time += t;
+}
+
+static inline void MPIh_prof_minmax(int n, const double *x, int stride, double *min, double *mean, double *max)
+{
+    *min = *max = x[0];
+    double sum = 0;
+    for (int i = 0; i < n; i++) {
+        double v = x[i * stride];
+        if (v < *min) *min = v;
+        if (v > *max) *max = v;
+        sum += v;
+    }
+    *mean = sum / n;
+}
+
+static inline void MPIh_profile_report(void)
+{   /* Collective on MPI_COMM_WORLD, called by MPI_Finalize */
+    int rank, size;
+    PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    PMPI_Comm_size(MPI_COMM_WORLD, &size);
+    /* Per rank: wall, MPI time, functions (calls, bytes, time), then its communicators 
+     * (leader, seq, size, calls, bytes, time), gathered apart since their number differs */
+    int nf = 3 * MPIH_PROF_N, stride = 2 + nf, nc = 6 * MPIh_prof.ncomms;
+    double *mine = calloc(stride + nc, sizeof(double)), *all = NULL, *comms = NULL, *time = NULL;
+    int *ncs = NULL, *displs = NULL;
+    if (rank == 0) {
+        all = malloc((size_t)size * stride * sizeof(double));
+        time = malloc(size * sizeof(double));
+        ncs = malloc(size * sizeof(int));
+        displs = malloc(size * sizeof(int));
+    }
+    bool error = !mine || (rank == 0 && (!all || !time || !ncs || !displs)), global_error;
+    PMPI_Allreduce(&error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) goto error;
+    mine[0] = PMPI_Wtime() - MPIh_prof.t0;
+    for (int f = 0; f < MPIH_PROF_N; f++) {
+        mine[2 + 3 * f] = MPIh_prof.f[f].calls;
+        mine[2 + 3 * f + 1] = MPIh_prof.f[f].bytes;
+        mine[2 + 3 * f + 2] = MPIh_prof.f[f].time;
+        mine[1] += MPIh_prof.f[f].time;
+    }
+    for (int k = 0; k < MPIh_prof.ncomms; k++) {
+        double *c = mine + stride + 6 * k;
+        c[0] = MPIh_prof.comms[k].leader;
+        c[1] = MPIh_prof.comms[k].seq;
+        c[2] = MPIh_prof.comms[k].size;
+        c[3] = MPIh_prof.comms[k].c.calls;
+        c[4] = MPIh_prof.comms[k].c.bytes;
+        c[5] = MPIh_prof.comms[k].c.time;
+    }
+    PMPI_Gather(mine, stride, MPI_DOUBLE, all, stride, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    PMPI_Gather(&nc, 1, MPI_INT, ncs, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    int total = 0;
+    if (rank == 0) {
+        for (int r = 0; r < size; r++) { displs[r] = total; total += ncs[r]; }
+        comms = malloc((total > 0 ? total : 1) * sizeof(double));
+        error = !comms;
+    }
+    PMPI_Bcast(&error, 1, MPI_C_BOOL, 0, MPI_COMM_WORLD);
+    if (error) goto error;
+    PMPI_Gatherv(mine + stride, nc, MPI_DOUBLE, comms, ncs, displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (rank != 0) goto done;
+
+    double min, mean, max, wall, mpi;
+    MPIh_prof_minmax(size, all, stride, &min, &wall, &max);
+    MPIh_prof_minmax(size, all + 1, stride, &min, &mpi, &max);
+    fprintf(stderr, "MPIh profile: %d ranks, wall %.3f s, time in MPI min / mean / max %.3f / %.3f / %.3f s (%.1f%% of wall)\n",
+            size, wall, min, mpi, max, wall > 0 ? 100 * mpi / wall : 0);
+    fprintf(stderr, "%-18s %12s %12s %10s %10s %10s %9s\n", "function", "calls", "MB", "min s", "mean s", "max s", "max/mean");
+    for (int f = 0; f < MPIH_PROF_N; f++) {
+        double calls = 0, bytes = 0;
+        for (int r = 0; r < size; r++) { calls += all[r * stride + 2 + 3 * f]; bytes += all[r * stride + 3 + 3 * f]; }
+        if (calls == 0) continue;
+        MPIh_prof_minmax(size, all + 4 + 3 * f, stride, &min, &mean, &max);
+        fprintf(stderr, "%-18s %12.0f %12.3f %10.4f %10.4f %10.4f %9.2f\n", MPIh_prof_names[f], calls, bytes / 1e6, min, mean, max, mean > 0 ? max / mean : 1);
+    }
+    /* Communicators: time of each member rank (the sum of its entries with that identity) */
+    fprintf(stderr, "%-18s %12s %12s %10s %10s %10s %9s\n", "communicator", "calls", "MB", "min s", "mean s", "max s", "max/mean");
+    for (int i = 0; i < total; i += 6) {
+        double *c = comms + i;
+        if (c[0] == -3) continue;  /* Already reported */
+        double leader = c[0], seq = c[1], csize = c[2], calls = 0, bytes = 0, sum = 0;
+        int members = 0;
+        for (int r = 0; r < size; r++) time[r] = -1;  /* Not a member */
+        for (int r = 0; r < size; r++) {
+            for (int j = displs[r]; j < displs[r] + ncs[r]; j += 6) {
+                double *d = comms + j;
+                if (d[0] != leader || d[1] != seq || d[2] != csize) continue;
+                calls += d[3]; bytes += d[4];
+                time[r] = (time[r] < 0 ? 0 : time[r]) + d[5];
+                d[0] = -3;
+            }
+        }
+        min = INFINITY; max = 0;
+        for (int r = 0; r < size; r++) {
+            if (time[r] < 0) continue;
+            if (time[r] < min) min = time[r];
+            if (time[r] > max) max = time[r];
+            sum += time[r];
+            members++;
+        }
+        char name[64];
+        if (leader == -2) snprintf(name, sizeof(name), "world");
+        else if (seq < 0) snprintf(name, sizeof(name), "size %.0f from %.0f", csize, leader);
+        else snprintf(name, sizeof(name), "size %.0f from %.0f#%.0f", csize, leader, seq);
+        mean = sum / members;
+        fprintf(stderr, "%-18s %12.0f %12.3f %10.4f %10.4f %10.4f %9.2f\n", name, calls, bytes / 1e6, min, mean, max, mean > 0 ? max / mean : 1);
+    }
+
+    goto done;
+
+error:
+    if (rank == 0) fprintf(stderr, "MPIh_profile_report: could not allocate.\n");
+done:
+    free(mine); free(all); free(comms); free(time); free(ncs); free(displs);
+}
+
+int MPI_Init(int *argc, char ***argv)
+{
+    int err = PMPI_Init(argc, argv);
+    MPIh_prof_start();
+    return err;
+}
+
+int MPI_Init_thread(int *argc, char ***argv, int required, int *provided)
+{
+    int err = PMPI_Init_thread(argc, argv, required, provided);
+    MPIh_prof_start();
+    return err;
+}
+
+int MPI_Finalize(void)
+{
+    MPIh_profile_report();
+    if (MPIh_prof.ready) PMPI_Comm_free_keyval(&MPIh_prof.keyval);
+    MPIh_prof.ready = false;
+    free(MPIh_prof.comms);
+    return PMPI_Finalize();
+}
+
+int MPI_Comm_dup(MPI_Comm comm, MPI_Comm *out)
+{
+    int err = PMPI_Comm_dup(comm, out);
+    if (err == MPI_SUCCESS) MPIh_prof_created(*out);
+    return err;
+}
+
+int MPI_Comm_split(MPI_Comm comm, int color, int key, MPI_Comm *out)
+{
+    int err = PMPI_Comm_split(comm, color, key, out);
+    if (err == MPI_SUCCESS) MPIh_prof_created(*out);
+    return err;
+}
+
+int MPI_Comm_split_type(MPI_Comm comm, int type, int key, MPI_Info info, MPI_Comm *out)
+{
+    int err = PMPI_Comm_split_type(comm, type, key, info, out);
+    if (err == MPI_SUCCESS) MPIh_prof_created(*out);
+    return err;
+}
+
+int MPI_Comm_create(MPI_Comm comm, MPI_Group group, MPI_Comm *out)
+{
+    int err = PMPI_Comm_create(comm, group, out);
+    if (err == MPI_SUCCESS) MPIh_prof_created(*out);
+    return err;
+}
+
+int MPI_Send(const void *buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Send(buf, count, type, dest, tag, comm);
+    MPIh_prof_record(MPIH_PROF_SEND, comm, MPIh_prof_bytes(count, type), t);
+    return err;
+}
+
+int MPI_Recv(void *buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm, MPI_Status *status)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Recv(buf, count, type, source, tag, comm, status);
+    MPIh_prof_record(MPIH_PROF_RECV, comm, MPIh_prof_bytes(count, type), t);
+    return err;
+}
+
+int MPI_Isend(const void *buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm, MPI_Request *req)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Isend(buf, count, type, dest, tag, comm, req);
+    MPIh_prof_record(MPIH_PROF_ISEND, comm, MPIh_prof_bytes(count, type), t);
+    return err;
+}
+
+int MPI_Irecv(void *buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm, MPI_Request *req)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Irecv(buf, count, type, source, tag, comm, req);
+    MPIh_prof_record(MPIH_PROF_IRECV, comm, MPIh_prof_bytes(count, type), t);
+    return err;
+}
+
+int MPI_Sendrecv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, int dest, int sendtag,
+                 void *recvbuf, int recvcount, MPI_Datatype recvtype, int source, int recvtag, MPI_Comm comm, MPI_Status *status)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Sendrecv(sendbuf, sendcount, sendtype, dest, sendtag, recvbuf, recvcount, recvtype, source, recvtag, comm, status);
+    MPIh_prof_record(MPIH_PROF_SENDRECV, comm, MPIh_prof_bytes(sendcount, sendtype), t);
+    return err;
+}
+
+int MPI_Wait(MPI_Request *req, MPI_Status *status)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Wait(req, status);
+    MPIh_prof_record(MPIH_PROF_WAIT, MPI_COMM_NULL, 0, t);
+    return err;
+}
+
+int MPI_Waitall(int count, MPI_Request reqs[], MPI_Status statuses[])
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Waitall(count, reqs, statuses);
+    MPIh_prof_record(MPIH_PROF_WAITALL, MPI_COMM_NULL, 0, t);
+    return err;
+}
+
+int MPI_Startall(int count, MPI_Request reqs[])
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Startall(count, reqs);
+    MPIh_prof_record(MPIH_PROF_STARTALL, MPI_COMM_NULL, 0, t);
+    return err;
+}
+
+int MPI_Barrier(MPI_Comm comm)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Barrier(comm);
+    MPIh_prof_record(MPIH_PROF_BARRIER, comm, 0, t);
+    return err;
+}
+
+int MPI_Bcast(void *buf, int count, MPI_Datatype type, int root, MPI_Comm comm)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Bcast(buf, count, type, root, comm);
+    MPIh_prof_record(MPIH_PROF_BCAST, comm, MPIh_prof_bytes(count, type), t);
+    return err;
+}
+
+int MPI_Ibcast(void *buf, int count, MPI_Datatype type, int root, MPI_Comm comm, MPI_Request *req)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Ibcast(buf, count, type, root, comm, req);
+    MPIh_prof_record(MPIH_PROF_IBCAST, comm, MPIh_prof_bytes(count, type), t);
+    return err;
+}
+
+int MPI_Reduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype type, MPI_Op op, int root, MPI_Comm comm)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Reduce(sendbuf, recvbuf, count, type, op, root, comm);
+    MPIh_prof_record(MPIH_PROF_REDUCE, comm, MPIh_prof_bytes(count, type), t);
+    return err;
+}
+
+int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Allreduce(sendbuf, recvbuf, count, type, op, comm);
+    MPIh_prof_record(MPIH_PROF_ALLREDUCE, comm, MPIh_prof_bytes(count, type), t);
+    return err;
+}
+
+int MPI_Gather(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+               MPI_Datatype recvtype, int root, MPI_Comm comm)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Gather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm);
+    MPIh_prof_record(MPIH_PROF_GATHER, comm, MPIh_prof_bytes(sendcount, sendtype), t);
+    return err;
+}
+
+int MPI_Allgather(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+                  MPI_Datatype recvtype, MPI_Comm comm)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Allgather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+    MPIh_prof_record(MPIH_PROF_ALLGATHER, comm, MPIh_prof_bytes(sendcount, sendtype), t);
+    return err;
+}
+
+int MPI_Allgatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, const int recvcounts[],
+                   const int displs[], MPI_Datatype recvtype, MPI_Comm comm)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Allgatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, comm);
+    MPIh_prof_record(MPIH_PROF_ALLGATHERV, comm, MPIh_prof_bytes(sendcount, sendtype), t);
+    return err;
+}
+
+int MPI_Alltoall(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+                 MPI_Datatype recvtype, MPI_Comm comm)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Alltoall(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+    int size;
+    PMPI_Comm_size(comm, &size);
+    MPIh_prof_record(MPIH_PROF_ALLTOALL, comm, size * MPIh_prof_bytes(sendcount, sendtype), t);
+    return err;
+}
+
+int MPI_Alltoallv(const void *sendbuf, const int sendcounts[], const int sdispls[], MPI_Datatype sendtype,
+                  void *recvbuf, const int recvcounts[], const int rdispls[], MPI_Datatype recvtype, MPI_Comm comm)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Alltoallv(sendbuf, sendcounts, sdispls, sendtype, recvbuf, recvcounts, rdispls, recvtype, comm);
+    int size;
+    PMPI_Comm_size(comm, &size);
+    double n = 0;
+    for (int j = 0; j < size; j++) n += sendcounts[j];
+    MPIh_prof_record(MPIH_PROF_ALLTOALLV, comm, n * MPIh_prof_bytes(1, sendtype), t);
+    return err;
+}
+
+int MPI_Exscan(const void *sendbuf, void *recvbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Exscan(sendbuf, recvbuf, count, type, op, comm);
+    MPIh_prof_record(MPIH_PROF_EXSCAN, comm, MPIh_prof_bytes(count, type), t);
+    return err;
+}
+
+int MPI_Fetch_and_op(const void *origin, void *result, MPI_Datatype type, int target, MPI_Aint disp, MPI_Op op, MPI_Win win)
+{
+    double t = PMPI_Wtime();
+    int err = PMPI_Fetch_and_op(origin, result, type, target, disp, op, win);
+    MPIh_prof_record(MPIH_PROF_FETCH_AND_OP, MPI_COMM_NULL, MPIh_prof_bytes(1, type), t);
+    return err;
+}
+
+#endif
+
 #endif
 
 /* MIT License.
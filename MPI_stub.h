@@ -0,0 +1,827 @@
+/*
+ * Header-only serial stand-in for the subset of MPI used by hlibs.
+ * Compile with -DHLIBS_MPI_STUB (no MPI library or mpicc needed) and MPI_helpers.h uses
+ * this header instead of <mpi.h>: the program runs as a single rank of MPI_COMM_WORLD.
+ * Collectives copy the send buffer to the receive buffer, RMA windows and shared windows
+ * are plain memory, MPI-IO maps to POSIX file calls, and messages to self are buffered
+ * (a send always completes; a receive that nothing matches aborts, as it would hang).
+ * Only builtin reduction ops matter with one rank, so user ops are accepted and ignored.
+ * State is per translation unit: handles (requests, windows, files) must not be shared
+ * between translation units.
+ *
+ * Copyright (c) 2026 Fernando Muñoz
+ * MIT license. See bottom of file.
+ */
+
+#ifndef HLIBS_MPI_STUB_H
+#define HLIBS_MPI_STUB_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define MPI_VERSION    3
+#define MPI_SUBVERSION 1
+
+#define MPI_SUCCESS     0
+#define MPI_ERR_OTHER   15
+#define MPI_UNDEFINED   (-32766)
+#define MPI_ANY_SOURCE  (-1)
+#define MPI_ANY_TAG     (-1)
+#define MPI_PROC_NULL   (-2)
+#define MPI_MAX_OBJECT_NAME 64
+
+#define MPI_THREAD_SINGLE     0
+#define MPI_THREAD_FUNNELED   1
+#define MPI_THREAD_SERIALIZED 2
+#define MPI_THREAD_MULTIPLE   3
+
+#define MPI_IN_PLACE ((void*)1)
+#define MPI_BOTTOM   ((void*)0)
+
+typedef intptr_t MPI_Aint;
+typedef int64_t  MPI_Offset;
+typedef int64_t  MPI_Count;
+
+typedef int MPI_Comm;
+#define MPI_COMM_NULL  0
+#define MPI_COMM_WORLD 1
+#define MPI_COMM_SELF  2
+#define MPI_COMM_TYPE_SHARED 1
+
+typedef int MPI_Info;
+#define MPI_INFO_NULL 0
+
+typedef int MPI_Group;
+#define MPI_GROUP_NULL 0
+
+typedef struct MPI_Status {
+    int MPI_SOURCE, MPI_TAG, MPI_ERROR;
+    size_t bytes;  /* Internal */
+} MPI_Status;
+#define MPI_STATUS_IGNORE   ((MPI_Status*)0)
+#define MPI_STATUSES_IGNORE ((MPI_Status*)0)
+
+
+/* Datatypes: size (bytes of data) and extent (stride between items). Kind for Fetch_and_op */
+typedef enum MPIstub_kind { MPISTUB_OTHER, MPISTUB_INT, MPISTUB_INT64, MPISTUB_UINT64, MPISTUB_DOUBLE } e_MPIstub_kind;
+
+typedef struct MPIstub_type {
+    MPI_Aint size, extent;
+    e_MPIstub_kind kind;
+    bool builtin;
+} *MPI_Datatype;
+#define MPI_DATATYPE_NULL ((MPI_Datatype)0)
+
+#define MPISTUB_TYPE(name, ctype, kind) \
+    static struct MPIstub_type MPIstub_##name __attribute__((unused)) = { sizeof(ctype), sizeof(ctype), kind, true }
+MPISTUB_TYPE(byte, char, MPISTUB_OTHER);
+MPISTUB_TYPE(char, char, MPISTUB_OTHER);
+MPISTUB_TYPE(short, short, MPISTUB_OTHER);
+MPISTUB_TYPE(int, int, MPISTUB_INT);
+MPISTUB_TYPE(unsigned, unsigned, MPISTUB_OTHER);
+MPISTUB_TYPE(long, long, MPISTUB_INT64);
+MPISTUB_TYPE(unsigned_long, unsigned long, MPISTUB_UINT64);
+MPISTUB_TYPE(long_long, long long, MPISTUB_INT64);
+MPISTUB_TYPE(float, float, MPISTUB_OTHER);
+MPISTUB_TYPE(double, double, MPISTUB_DOUBLE);
+MPISTUB_TYPE(int8, int8_t, MPISTUB_OTHER);
+MPISTUB_TYPE(uint8, uint8_t, MPISTUB_OTHER);
+MPISTUB_TYPE(int32, int32_t, MPISTUB_OTHER);
+MPISTUB_TYPE(uint32, uint32_t, MPISTUB_OTHER);
+MPISTUB_TYPE(int64, int64_t, MPISTUB_INT64);
+MPISTUB_TYPE(uint64, uint64_t, MPISTUB_UINT64);
+MPISTUB_TYPE(bool, bool, MPISTUB_OTHER);
+MPISTUB_TYPE(aint, MPI_Aint, MPISTUB_INT64);
+MPISTUB_TYPE(offset, MPI_Offset, MPISTUB_INT64);
+#define MPI_BYTE           (&MPIstub_byte)
+#define MPI_CHAR           (&MPIstub_char)
+#define MPI_SHORT          (&MPIstub_short)
+#define MPI_INT            (&MPIstub_int)
+#define MPI_UNSIGNED       (&MPIstub_unsigned)
+#define MPI_LONG           (&MPIstub_long)
+#define MPI_UNSIGNED_LONG  (&MPIstub_unsigned_long)
+#define MPI_LONG_LONG      (&MPIstub_long_long)
+#define MPI_FLOAT          (&MPIstub_float)
+#define MPI_DOUBLE         (&MPIstub_double)
+#define MPI_INT8_T         (&MPIstub_int8)
+#define MPI_UINT8_T        (&MPIstub_uint8)
+#define MPI_INT32_T        (&MPIstub_int32)
+#define MPI_UINT32_T       (&MPIstub_uint32)
+#define MPI_INT64_T        (&MPIstub_int64)
+#define MPI_UINT64_T       (&MPIstub_uint64)
+#define MPI_C_BOOL         (&MPIstub_bool)
+#define MPI_AINT           (&MPIstub_aint)
+#define MPI_OFFSET         (&MPIstub_offset)
+
+
+/* Reduction ops: only their identity is needed with one rank (and by Fetch_and_op) */
+typedef int MPI_Op;
+#define MPI_OP_NULL 0
+#define MPI_MAX     1
+#define MPI_MIN     2
+#define MPI_SUM     3
+#define MPI_PROD    4
+#define MPI_LAND    5
+#define MPI_LOR     6
+#define MPI_BAND    7
+#define MPI_BOR     8
+#define MPI_BXOR    9
+#define MPI_REPLACE 10
+#define MPI_NO_OP   11
+typedef void (MPI_User_function)(void *in, void *inout, int *len, MPI_Datatype *type);
+
+
+/* Requests: nonblocking operations with self and persistent requests */
+typedef struct MPIstub_request {
+    bool send, persistent, active, done;
+    void *buf;
+    size_t bytes;
+    int tag;
+    MPI_Status status;
+    struct MPIstub_request *next;  /* Pending receives */
+} *MPI_Request;
+#define MPI_REQUEST_NULL ((MPI_Request)0)
+
+typedef struct MPIstub_message {  /* Buffered send to self */
+    int tag;
+    size_t bytes;
+    struct MPIstub_message *next;
+    /* Data follows */
+} s_MPIstub_message;
+
+static struct {
+    bool initialized, finalized;
+    s_MPIstub_message *messages, *last_message;  /* FIFO */
+    MPI_Request receives, last_receive;          /* FIFO of posted receives */
+    int next_comm;
+    int next_op;
+} MPIstub;
+
+
+/* Windows */
+typedef struct MPIstub_win {
+    char *base;
+    MPI_Aint size;
+    int disp_unit;
+    bool owned;
+} *MPI_Win;
+#define MPI_WIN_NULL ((MPI_Win)0)
+#define MPI_MODE_NOCHECK   1024
+#define MPI_MODE_NOSTORE   2048
+#define MPI_MODE_NOPUT     4096
+#define MPI_MODE_NOPRECEDE 8192
+#define MPI_MODE_NOSUCCEED 16384
+#define MPI_LOCK_EXCLUSIVE 234
+#define MPI_LOCK_SHARED    235
+
+
+/* Files */
+typedef struct MPIstub_file {
+    int fd;
+} *MPI_File;
+#define MPI_FILE_NULL ((MPI_File)0)
+#define MPI_MODE_RDONLY          2
+#define MPI_MODE_RDWR            8
+#define MPI_MODE_WRONLY          4
+#define MPI_MODE_CREATE          1
+#define MPI_MODE_EXCL            64
+#define MPI_MODE_DELETE_ON_CLOSE 16
+#define MPI_MODE_UNIQUE_OPEN     32
+#define MPI_MODE_APPEND          128
+#define MPI_MODE_SEQUENTIAL      256
+
+
+/* IMPLEMENTATION */
+static inline double MPI_Wtime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static inline double MPI_Wtick(void) { return 1e-9; }
+
+static inline int MPI_Init(int *argc, char ***argv)
+{
+    (void)argc; (void)argv;
+    MPIstub.initialized = true;
+    MPIstub.next_comm = 3;
+    MPIstub.next_op = 100;
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Init_thread(int *argc, char ***argv, int required, int *provided)
+{   /* Any level is granted: only self-messages keep state, and they are not thread-safe */
+    *provided = required;
+    return MPI_Init(argc, argv);
+}
+
+static inline int MPI_Initialized(int *flag) { *flag = MPIstub.initialized; return MPI_SUCCESS; }
+static inline int MPI_Finalized(int *flag) { *flag = MPIstub.finalized; return MPI_SUCCESS; }
+
+static inline int MPI_Finalize(void)
+{
+    while (MPIstub.messages) {
+        s_MPIstub_message *m = MPIstub.messages;
+        MPIstub.messages = m->next;
+        free(m);
+    }
+    MPIstub.last_message = NULL;
+    MPIstub.finalized = true;
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Abort(MPI_Comm comm, int code)
+{
+    (void)comm;
+    fprintf(stderr, "MPI_Abort: code %d.\n", code);
+    exit(code);
+}
+
+static inline int MPI_Comm_rank(MPI_Comm comm, int *rank) { (void)comm; *rank = 0; return MPI_SUCCESS; }
+static inline int MPI_Comm_size(MPI_Comm comm, int *size) { (void)comm; *size = 1; return MPI_SUCCESS; }
+
+static inline int MPI_Comm_dup(MPI_Comm comm, MPI_Comm *out) { (void)comm; *out = MPIstub.next_comm++; return MPI_SUCCESS; }
+
+static inline int MPI_Comm_split(MPI_Comm comm, int color, int key, MPI_Comm *out)
+{
+    (void)key;
+    if (color == MPI_UNDEFINED) { *out = MPI_COMM_NULL; return MPI_SUCCESS; }
+    return MPI_Comm_dup(comm, out);
+}
+
+static inline int MPI_Comm_split_type(MPI_Comm comm, int type, int key, MPI_Info info, MPI_Comm *out)
+{
+    (void)info;
+    return MPI_Comm_split(comm, type, key, out);
+}
+
+static inline int MPI_Comm_free(MPI_Comm *comm) { *comm = MPI_COMM_NULL; return MPI_SUCCESS; }
+
+
+/* Datatypes */
+static inline int MPI_Type_size(MPI_Datatype type, int *size) { *size = (int)type->size; return MPI_SUCCESS; }
+
+static inline int MPI_Type_get_extent(MPI_Datatype type, MPI_Aint *lb, MPI_Aint *extent)
+{
+    *lb = 0;
+    *extent = type->extent;
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Type_contiguous(int count, MPI_Datatype old, MPI_Datatype *out)
+{
+    *out = malloc(sizeof(**out));
+    if (!*out) return MPI_ERR_OTHER;
+    **out = (struct MPIstub_type){ .size = count * old->size, .extent = count * old->extent, .kind = MPISTUB_OTHER };
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Type_create_struct(int count, const int blocklengths[], const MPI_Aint displs[], const MPI_Datatype types[], MPI_Datatype *out)
+{
+    *out = malloc(sizeof(**out));
+    if (!*out) return MPI_ERR_OTHER;
+    MPI_Aint size = 0, extent = 0;
+    for (int i = 0; i < count; i++) {
+        size += blocklengths[i] * types[i]->size;
+        MPI_Aint end = displs[i] + blocklengths[i] * types[i]->extent;
+        if (end > extent) extent = end;
+    }
+    **out = (struct MPIstub_type){ .size = size, .extent = extent, .kind = MPISTUB_OTHER };
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Type_create_resized(MPI_Datatype old, MPI_Aint lb, MPI_Aint extent, MPI_Datatype *out)
+{
+    (void)lb;
+    *out = malloc(sizeof(**out));
+    if (!*out) return MPI_ERR_OTHER;
+    **out = (struct MPIstub_type){ .size = old->size, .extent = extent, .kind = old->kind };
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Type_commit(MPI_Datatype *type) { (void)type; return MPI_SUCCESS; }
+
+static inline int MPI_Type_free(MPI_Datatype *type)
+{
+    if (*type && !(*type)->builtin) free(*type);
+    *type = MPI_DATATYPE_NULL;
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Op_create(MPI_User_function *fn, int commute, MPI_Op *op)
+{
+    (void)fn; (void)commute;
+    *op = MPIstub.next_op++;
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Op_free(MPI_Op *op) { *op = MPI_OP_NULL; return MPI_SUCCESS; }
+
+
+/* Point-to-point, only with self (rank 0) or MPI_PROC_NULL */
+static inline bool MPIstub_match(MPI_Request r, const s_MPIstub_message *m)
+{
+    return r->tag == MPI_ANY_TAG || r->tag == m->tag;
+}
+
+static inline void MPIstub_deliver(MPI_Request r, s_MPIstub_message *m)
+{   /* Copies message m into receive r and frees m */
+    size_t n = m->bytes < r->bytes ? m->bytes : r->bytes;
+    if (m->bytes > r->bytes) fprintf(stderr, "MPI stub: message of %zu bytes truncated to %zu.\n", m->bytes, r->bytes);
+    memcpy(r->buf, m + 1, n);
+    r->status = (MPI_Status){ .MPI_SOURCE = 0, .MPI_TAG = m->tag, .MPI_ERROR = MPI_SUCCESS, .bytes = n };
+    r->done = true;
+    free(m);
+}
+
+static inline int MPIstub_post(MPI_Request r)
+{   /* Starts request r: sends are buffered (or delivered to a posted receive), receives take a
+     * buffered message or wait in the queue */
+    r->active = true;
+    r->done = false;
+    if (r->send) {
+        for (MPI_Request *p = &MPIstub.receives, prev = NULL; *p; prev = *p, p = &(*p)->next) {
+            if ((*p)->tag != MPI_ANY_TAG && (*p)->tag != r->tag) continue;
+            MPI_Request q = *p;
+            *p = q->next;
+            if (MPIstub.last_receive == q) MPIstub.last_receive = prev;
+            size_t n = r->bytes < q->bytes ? r->bytes : q->bytes;
+            memcpy(q->buf, r->buf, n);
+            q->status = (MPI_Status){ .MPI_SOURCE = 0, .MPI_TAG = r->tag, .MPI_ERROR = MPI_SUCCESS, .bytes = n };
+            q->done = true;
+            r->done = true;
+            return MPI_SUCCESS;
+        }
+        s_MPIstub_message *m = malloc(sizeof(*m) + r->bytes);
+        if (!m) return MPI_ERR_OTHER;
+        *m = (s_MPIstub_message){ .tag = r->tag, .bytes = r->bytes };
+        if (r->bytes > 0) memcpy(m + 1, r->buf, r->bytes);
+        if (MPIstub.last_message) MPIstub.last_message->next = m;
+        else MPIstub.messages = m;
+        MPIstub.last_message = m;
+        r->done = true;
+        return MPI_SUCCESS;
+    }
+    s_MPIstub_message *prev = NULL;
+    for (s_MPIstub_message *m = MPIstub.messages; m; prev = m, m = m->next) {
+        if (!MPIstub_match(r, m)) continue;
+        if (prev) prev->next = m->next;
+        else MPIstub.messages = m->next;
+        if (MPIstub.last_message == m) MPIstub.last_message = prev;
+        MPIstub_deliver(r, m);
+        return MPI_SUCCESS;
+    }
+    r->next = NULL;
+    if (MPIstub.last_receive) MPIstub.last_receive->next = r;
+    else MPIstub.receives = r;
+    MPIstub.last_receive = r;
+    return MPI_SUCCESS;
+}
+
+static inline int MPIstub_request(bool send, bool persistent, const void *buf, int count, MPI_Datatype type, int peer, int tag, MPI_Request *req)
+{
+    if (peer == MPI_PROC_NULL) {
+        *req = MPI_REQUEST_NULL;
+        return MPI_SUCCESS;
+    }
+    if (peer != 0 && peer != MPI_ANY_SOURCE) {
+        fprintf(stderr, "MPI stub: rank %d does not exist (single rank).\n", peer);
+        return MPI_ERR_OTHER;
+    }
+    MPI_Request r = calloc(1, sizeof(*r));
+    if (!r) return MPI_ERR_OTHER;
+    r->send = send;
+    r->persistent = persistent;
+    r->buf = (void*)buf;
+    r->bytes = (size_t)count * type->extent;
+    r->tag = tag;
+    *req = r;
+    return persistent ? MPI_SUCCESS : MPIstub_post(r);
+}
+
+static inline int MPI_Wait(MPI_Request *req, MPI_Status *status)
+{
+    MPI_Request r = *req;
+    if (r == MPI_REQUEST_NULL || !r->active) {
+        if (status) *status = (MPI_Status){ .MPI_SOURCE = MPI_PROC_NULL, .MPI_TAG = MPI_ANY_TAG };
+        return MPI_SUCCESS;
+    }
+    if (!r->done) {
+        fprintf(stderr, "MPI stub: waiting on a receive (tag %d) that no send matches, it would never complete.\n", r->tag);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (status) *status = r->status;
+    r->active = false;
+    if (!r->persistent) {
+        free(r);
+        *req = MPI_REQUEST_NULL;
+    }
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Waitall(int count, MPI_Request reqs[], MPI_Status statuses[])
+{
+    for (int i = 0; i < count; i++) MPI_Wait(&reqs[i], statuses ? &statuses[i] : MPI_STATUS_IGNORE);
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Test(MPI_Request *req, int *flag, MPI_Status *status)
+{
+    *flag = *req == MPI_REQUEST_NULL || !(*req)->active || (*req)->done;
+    if (*flag) MPI_Wait(req, status);
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Testall(int count, MPI_Request reqs[], int *flag, MPI_Status statuses[])
+{
+    *flag = 1;
+    for (int i = 0; i < count; i++) if (reqs[i] != MPI_REQUEST_NULL && reqs[i]->active && !reqs[i]->done) *flag = 0;
+    if (*flag) MPI_Waitall(count, reqs, statuses);
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Isend(const void *buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm, MPI_Request *req)
+{
+    (void)comm;
+    return MPIstub_request(true, false, buf, count, type, dest, tag, req);
+}
+
+static inline int MPI_Irecv(void *buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm, MPI_Request *req)
+{
+    (void)comm;
+    return MPIstub_request(false, false, buf, count, type, source, tag, req);
+}
+
+static inline int MPI_Send(const void *buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm)
+{
+    MPI_Request r;
+    int err = MPI_Isend(buf, count, type, dest, tag, comm, &r);
+    if (err == MPI_SUCCESS) MPI_Wait(&r, MPI_STATUS_IGNORE);
+    return err;
+}
+
+static inline int MPI_Recv(void *buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm, MPI_Status *status)
+{
+    MPI_Request r;
+    int err = MPI_Irecv(buf, count, type, source, tag, comm, &r);
+    if (err == MPI_SUCCESS) MPI_Wait(&r, status);
+    return err;
+}
+
+static inline int MPI_Sendrecv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, int dest, int sendtag,
+                               void *recvbuf, int recvcount, MPI_Datatype recvtype, int source, int recvtag, MPI_Comm comm, MPI_Status *status)
+{
+    MPI_Request r;
+    int err = MPI_Irecv(recvbuf, recvcount, recvtype, source, recvtag, comm, &r);
+    if (err == MPI_SUCCESS) err = MPI_Send(sendbuf, sendcount, sendtype, dest, sendtag, comm);
+    if (err == MPI_SUCCESS) MPI_Wait(&r, status);
+    return err;
+}
+
+static inline int MPI_Send_init(const void *buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm, MPI_Request *req)
+{
+    (void)comm;
+    return MPIstub_request(true, true, buf, count, type, dest, tag, req);
+}
+
+static inline int MPI_Recv_init(void *buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm, MPI_Request *req)
+{
+    (void)comm;
+    return MPIstub_request(false, true, buf, count, type, source, tag, req);
+}
+
+static inline int MPI_Start(MPI_Request *req) { return *req ? MPIstub_post(*req) : MPI_SUCCESS; }
+
+static inline int MPI_Startall(int count, MPI_Request reqs[])
+{
+    for (int i = 0; i < count; i++) MPI_Start(&reqs[i]);
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Request_free(MPI_Request *req)
+{
+    MPI_Request r = *req;
+    if (r && r->active && !r->done) {  /* Remove a pending receive */
+        for (MPI_Request *p = &MPIstub.receives, prev = NULL; *p; prev = *p, p = &(*p)->next) {
+            if (*p != r) continue;
+            *p = r->next;
+            if (MPIstub.last_receive == r) MPIstub.last_receive = prev;
+            break;
+        }
+    }
+    free(r);
+    *req = MPI_REQUEST_NULL;
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Get_count(const MPI_Status *status, MPI_Datatype type, int *count)
+{
+    *count = (int)(status->bytes / type->extent);
+    return MPI_SUCCESS;
+}
+
+
+/* Collectives: one rank, so data only moves from the send to the receive buffer */
+static inline void MPIstub_copy(const void *send, void *recv, MPI_Aint count, MPI_Datatype type)
+{
+    if (send != MPI_IN_PLACE && send != recv && count > 0) memcpy(recv, send, count * type->extent);
+}
+
+static inline int MPI_Barrier(MPI_Comm comm) { (void)comm; return MPI_SUCCESS; }
+
+static inline int MPI_Bcast(void *buf, int count, MPI_Datatype type, int root, MPI_Comm comm)
+{
+    (void)buf; (void)count; (void)type; (void)root; (void)comm;
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Ibcast(void *buf, int count, MPI_Datatype type, int root, MPI_Comm comm, MPI_Request *req)
+{
+    (void)buf; (void)count; (void)type; (void)root; (void)comm;
+    *req = MPI_REQUEST_NULL;
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Reduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype type, MPI_Op op, int root, MPI_Comm comm)
+{
+    (void)op; (void)root; (void)comm;
+    MPIstub_copy(sendbuf, recvbuf, count, type);
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm)
+{
+    return MPI_Reduce(sendbuf, recvbuf, count, type, op, 0, comm);
+}
+
+static inline int MPI_Scan(const void *sendbuf, void *recvbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm)
+{
+    return MPI_Reduce(sendbuf, recvbuf, count, type, op, 0, comm);
+}
+
+static inline int MPI_Exscan(const void *sendbuf, void *recvbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm)
+{   /* recvbuf is undefined on rank 0 */
+    (void)sendbuf; (void)recvbuf; (void)count; (void)type; (void)op; (void)comm;
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Gather(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+                             MPI_Datatype recvtype, int root, MPI_Comm comm)
+{
+    (void)recvcount; (void)recvtype; (void)root; (void)comm;
+    MPIstub_copy(sendbuf, recvbuf, sendcount, sendtype);
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Scatter(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+                              MPI_Datatype recvtype, int root, MPI_Comm comm)
+{
+    (void)sendcount; (void)sendtype; (void)root; (void)comm;
+    if (recvbuf != MPI_IN_PLACE) MPIstub_copy(sendbuf, recvbuf, recvcount, recvtype);
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Allgather(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+                                MPI_Datatype recvtype, MPI_Comm comm)
+{
+    return MPI_Gather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, 0, comm);
+}
+
+static inline int MPI_Gatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, const int recvcounts[],
+                              const int displs[], MPI_Datatype recvtype, int root, MPI_Comm comm)
+{
+    (void)recvcounts; (void)root; (void)comm;
+    if (sendbuf != MPI_IN_PLACE) MPIstub_copy(sendbuf, (char*)recvbuf + displs[0] * recvtype->extent, sendcount, sendtype);
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Allgatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, const int recvcounts[],
+                                 const int displs[], MPI_Datatype recvtype, MPI_Comm comm)
+{
+    return MPI_Gatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, 0, comm);
+}
+
+static inline int MPI_Alltoall(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+                               MPI_Datatype recvtype, MPI_Comm comm)
+{
+    (void)recvcount; (void)recvtype; (void)comm;
+    MPIstub_copy(sendbuf, recvbuf, sendcount, sendtype);
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Alltoallv(const void *sendbuf, const int sendcounts[], const int sdispls[], MPI_Datatype sendtype,
+                                void *recvbuf, const int recvcounts[], const int rdispls[], MPI_Datatype recvtype, MPI_Comm comm)
+{
+    (void)recvcounts; (void)comm;
+    if (sendbuf != MPI_IN_PLACE)
+        MPIstub_copy((const char*)sendbuf + sdispls[0] * sendtype->extent, (char*)recvbuf + rdispls[0] * recvtype->extent, sendcounts[0], sendtype);
+    return MPI_SUCCESS;
+}
+
+
+/* One-sided: windows are plain memory */
+static inline int MPI_Win_allocate(MPI_Aint size, int disp_unit, MPI_Info info, MPI_Comm comm, void *baseptr, MPI_Win *win)
+{
+    (void)info; (void)comm;
+    *win = malloc(sizeof(**win));
+    char *base = malloc(size > 0 ? size : 1);
+    if (!*win || !base) { free(*win); free(base); return MPI_ERR_OTHER; }
+    **win = (struct MPIstub_win){ .base = base, .size = size, .disp_unit = disp_unit, .owned = true };
+    *(void**)baseptr = base;
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Win_allocate_shared(MPI_Aint size, int disp_unit, MPI_Info info, MPI_Comm comm, void *baseptr, MPI_Win *win)
+{
+    return MPI_Win_allocate(size, disp_unit, info, comm, baseptr, win);
+}
+
+static inline int MPI_Win_create(void *base, MPI_Aint size, int disp_unit, MPI_Info info, MPI_Comm comm, MPI_Win *win)
+{
+    (void)info; (void)comm;
+    *win = malloc(sizeof(**win));
+    if (!*win) return MPI_ERR_OTHER;
+    **win = (struct MPIstub_win){ .base = base, .size = size, .disp_unit = disp_unit, .owned = false };
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Win_shared_query(MPI_Win win, int rank, MPI_Aint *size, int *disp_unit, void *baseptr)
+{
+    (void)rank;
+    *size = win->size;
+    *disp_unit = win->disp_unit;
+    *(void**)baseptr = win->base;
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Win_free(MPI_Win *win)
+{
+    if ((*win)->owned) free((*win)->base);
+    free(*win);
+    *win = MPI_WIN_NULL;
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Win_lock_all(int assert_, MPI_Win win) { (void)assert_; (void)win; return MPI_SUCCESS; }
+static inline int MPI_Win_unlock_all(MPI_Win win) { (void)win; return MPI_SUCCESS; }
+static inline int MPI_Win_lock(int type, int rank, int assert_, MPI_Win win) { (void)type; (void)rank; (void)assert_; (void)win; return MPI_SUCCESS; }
+static inline int MPI_Win_unlock(int rank, MPI_Win win) { (void)rank; (void)win; return MPI_SUCCESS; }
+static inline int MPI_Win_flush(int rank, MPI_Win win) { (void)rank; (void)win; return MPI_SUCCESS; }
+static inline int MPI_Win_flush_all(MPI_Win win) { (void)win; return MPI_SUCCESS; }
+static inline int MPI_Win_sync(MPI_Win win) { (void)win; return MPI_SUCCESS; }
+static inline int MPI_Win_fence(int assert_, MPI_Win win) { (void)assert_; (void)win; return MPI_SUCCESS; }
+
+static inline int MPI_Put(const void *origin, int count, MPI_Datatype otype, int target, MPI_Aint disp, int tcount, MPI_Datatype ttype, MPI_Win win)
+{
+    (void)target; (void)tcount; (void)ttype;
+    MPIstub_copy(origin, win->base + disp * win->disp_unit, count, otype);
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Get(void *origin, int count, MPI_Datatype otype, int target, MPI_Aint disp, int tcount, MPI_Datatype ttype, MPI_Win win)
+{
+    (void)target; (void)tcount; (void)ttype;
+    MPIstub_copy(win->base + disp * win->disp_unit, origin, count, otype);
+    return MPI_SUCCESS;
+}
+
+#define MPISTUB_APPLY(ctype) do {                                       \
+        ctype *t = (ctype*)target, o = *(const ctype*)origin;           \
+        *(ctype*)result = *t;                                           \
+        if (op == MPI_SUM) *t += o;                                     \
+        else if (op == MPI_PROD) *t *= o;                               \
+        else if (op == MPI_MAX) *t = *t > o ? *t : o;                   \
+        else if (op == MPI_MIN) *t = *t < o ? *t : o;                   \
+        else if (op == MPI_REPLACE) *t = o;                             \
+    } while (0)
+
+static inline int MPI_Fetch_and_op(const void *origin, void *result, MPI_Datatype type, int rank, MPI_Aint disp, MPI_Op op, MPI_Win win)
+{   /* SUM, PROD, MAX, MIN, REPLACE and NO_OP on int, 64-bit integers and double */
+    (void)rank;
+    char *target = win->base + disp * win->disp_unit;
+    switch (type->kind) {
+        case MPISTUB_INT:    MPISTUB_APPLY(int); break;
+        case MPISTUB_INT64:  MPISTUB_APPLY(int64_t); break;
+        case MPISTUB_UINT64: MPISTUB_APPLY(uint64_t); break;
+        case MPISTUB_DOUBLE: MPISTUB_APPLY(double); break;
+        default:
+            fprintf(stderr, "MPI_Fetch_and_op: datatype not supported by the stub.\n");
+            return MPI_ERR_OTHER;
+    }
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_Compare_and_swap(const void *origin, const void *compare, void *result, MPI_Datatype type, int rank, MPI_Aint disp, MPI_Win win)
+{
+    (void)rank;
+    char *target = win->base + disp * win->disp_unit;
+    memcpy(result, target, type->size);
+    if (memcmp(target, compare, type->size) == 0) memcpy(target, origin, type->size);
+    return MPI_SUCCESS;
+}
+
+
+/* MPI-IO over POSIX files */
+static inline int MPI_File_open(MPI_Comm comm, const char *path, int amode, MPI_Info info, MPI_File *fh)
+{
+    (void)comm; (void)info;
+    int flags = (amode & MPI_MODE_RDWR) ? O_RDWR : (amode & MPI_MODE_WRONLY) ? O_WRONLY : O_RDONLY;
+    if (amode & MPI_MODE_CREATE) flags |= O_CREAT;
+    if (amode & MPI_MODE_EXCL) flags |= O_EXCL;
+    int fd = open(path, flags, 0644);
+    if (fd < 0) return MPI_ERR_OTHER;
+    if (amode & MPI_MODE_DELETE_ON_CLOSE) unlink(path);
+    *fh = malloc(sizeof(**fh));
+    if (!*fh) { close(fd); return MPI_ERR_OTHER; }
+    (*fh)->fd = fd;
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_File_close(MPI_File *fh)
+{
+    int err = close((*fh)->fd) == 0 ? MPI_SUCCESS : MPI_ERR_OTHER;
+    free(*fh);
+    *fh = MPI_FILE_NULL;
+    return err;
+}
+
+static inline int MPI_File_delete(const char *path, MPI_Info info) { (void)info; return unlink(path) == 0 ? MPI_SUCCESS : MPI_ERR_OTHER; }
+
+static inline int MPI_File_get_size(MPI_File fh, MPI_Offset *size)
+{
+    struct stat st;
+    *size = 0;
+    if (fstat(fh->fd, &st) != 0) return MPI_ERR_OTHER;
+    *size = st.st_size;
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_File_set_size(MPI_File fh, MPI_Offset size) { return ftruncate(fh->fd, size) == 0 ? MPI_SUCCESS : MPI_ERR_OTHER; }
+static inline int MPI_File_sync(MPI_File fh) { return fsync(fh->fd) == 0 ? MPI_SUCCESS : MPI_ERR_OTHER; }
+
+static inline int MPI_File_read_at(MPI_File fh, MPI_Offset offset, void *buf, int count, MPI_Datatype type, MPI_Status *status)
+{
+    size_t n = (size_t)count * type->extent, done = 0;
+    while (done < n) {
+        ssize_t r = pread(fh->fd, (char*)buf + done, n - done, offset + done);
+        if (r < 0) return MPI_ERR_OTHER;
+        if (r == 0) break;  /* End of file */
+        done += r;
+    }
+    if (status) *status = (MPI_Status){ .MPI_ERROR = MPI_SUCCESS, .bytes = done };
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_File_write_at(MPI_File fh, MPI_Offset offset, const void *buf, int count, MPI_Datatype type, MPI_Status *status)
+{
+    size_t n = (size_t)count * type->extent, done = 0;
+    while (done < n) {
+        ssize_t w = pwrite(fh->fd, (const char*)buf + done, n - done, offset + done);
+        if (w <= 0) return MPI_ERR_OTHER;
+        done += w;
+    }
+    if (status) *status = (MPI_Status){ .MPI_ERROR = MPI_SUCCESS, .bytes = done };
+    return MPI_SUCCESS;
+}
+
+static inline int MPI_File_read_at_all(MPI_File fh, MPI_Offset offset, void *buf, int count, MPI_Datatype type, MPI_Status *status)
+{
+    return MPI_File_read_at(fh, offset, buf, count, type, status);
+}
+
+static inline int MPI_File_write_at_all(MPI_File fh, MPI_Offset offset, const void *buf, int count, MPI_Datatype type, MPI_Status *status)
+{
+    return MPI_File_write_at(fh, offset, buf, count, type, status);
+}
+
+#endif
+
+/* MIT License.
+ *
+ * Copyright (c) 2026 Fernando Muñoz.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
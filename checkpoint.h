@@ -0,0 +1,476 @@
+/*
+ * Header-only collective checkpoint/restart with MPI-IO.
+ * Named objects are registered once (in the same order on every rank): distributed
+ * dynarrays (each rank holds a part), random contexts, s_sample accumulators and plain
+ * values equal on every rank. checkpoint_write stores all of them in ONE file, each rank
+ * writing its part at an offset computed with MPI_Exscan:
+ *     [ header ][ entry 0: rank 0 part | rank 1 part | ... ][ entry 1 ... ][ manifest ]
+ * The manifest is text (name, kind, item size, offset, bytes, and the items of each rank),
+ * so `tail` shows what a checkpoint holds. The file is written as path.tmp and renamed, so
+ * a crash while writing leaves the previous checkpoint intact.
+ * checkpoint_read restores by name and may run on a different number of ranks:
+ *     dynarray  the parts, concatenated in rank order, are split in MPIh_partition_block
+ *               ranges (the saved split is kept if the number of ranks did not change);
+ *     random    each rank gets its own saved contexts back if the number of ranks did not
+ *               change, otherwise they are dealt to the new ranks in order; contexts beyond
+ *               the saved ones are numbered after them across ranks and derived from the last
+ *               saved context by long jumps (2^192), so streams stay disjoint;
+ *     sample    with another number of ranks, rank 0 gets the merge of all saved samples
+ *               and the others an empty one, so the global reduction is unchanged;
+ *     value     read by every rank.
+ *
+ * Copyright (c) 2026 Fernando Muñoz
+ * MIT license. See bottom of file.
+ */
+
+#ifndef HLIBS_CHECKPOINT_H
+#define HLIBS_CHECKPOINT_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "MPI_helpers.h"
+#include "dynarray.h"
+#include "random.h"
+#include "stats.h"
+
+#define CHECKPOINT_NAME    64  /* Max name length, including the terminator. No whitespace */
+#define CHECKPOINT_MAGIC   "HLIBSCKP"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_HEADER  64  /* Bytes before the first entry */
+
+typedef enum {
+    CHECKPOINT_DYNARRAY,
+    CHECKPOINT_RANDOM,
+    CHECKPOINT_SAMPLE,
+    CHECKPOINT_VALUE,
+} e_checkpoint_kind;
+
+typedef struct checkpoint_entry {
+    char name[CHECKPOINT_NAME];
+    e_checkpoint_kind kind;
+    void *ptr;         /* s_dynarray*, s_random_context[n], s_sample* or the value */
+    size_t item_size;  /* Bytes per item (the value size for CHECKPOINT_VALUE) */
+    int n;             /* Random contexts of this rank */
+} s_checkpoint_entry;
+
+typedef struct checkpoint {
+    s_dynarray entries;  /* s_checkpoint_entry */
+} s_checkpoint;
+
+
+
+/* INTERFACE */
+/* All functions returning int, return 0 on ERROR, 1 on SUCCESS. */
+static inline int checkpoint_init(s_checkpoint *cp);
+static inline void checkpoint_free(s_checkpoint *cp);  /* Registered objects are not touched */
+static inline int checkpoint_register_dynarray(s_checkpoint *cp, const char *name, s_dynarray *arr);
+static inline int checkpoint_register_random(s_checkpoint *cp, const char *name, int n, s_random_context ctx[n]);
+static inline int checkpoint_register_sample(s_checkpoint *cp, const char *name, s_sample *sample);
+static inline int checkpoint_register_value(s_checkpoint *cp, const char *name, void *ptr, size_t size);
+static inline int checkpoint_write(const s_checkpoint *cp, const char *path);  /* Collective */
+static inline int checkpoint_read(s_checkpoint *cp, const char *path);  /* Collective */
+
+
+
+/* IMPLEMENTATION */
+static inline int checkpoint_init(s_checkpoint *cp)
+{
+    cp->entries = dynarray_initialize(sizeof(s_checkpoint_entry), 0);
+    return cp->entries.items != NULL;
+}
+
+static inline void checkpoint_free(s_checkpoint *cp)
+{
+    dynarray_free(&cp->entries);
+}
+
+static inline int checkpoint_register(s_checkpoint *cp, const char *name, e_checkpoint_kind kind, void *ptr, size_t item_size, int n)
+{
+    size_t len = strlen(name);
+    if (len == 0 || len >= CHECKPOINT_NAME || strpbrk(name, " \t\n")) {
+        fprintf(stderr, "checkpoint_register: invalid name '%s'.\n", name);
+        return 0;
+    }
+    for (unsigned i = 0; i < cp->entries.N; i++) {
+        if (strcmp(((s_checkpoint_entry*)cp->entries.items)[i].name, name) == 0) {
+            fprintf(stderr, "checkpoint_register: '%s' is already registered.\n", name);
+            return 0;
+        }
+    }
+    s_checkpoint_entry e = { .kind = kind, .ptr = ptr, .item_size = item_size, .n = n };
+    memcpy(e.name, name, len + 1);
+    return dynarray_push(&cp->entries, &e);
+}
+
+static inline int checkpoint_register_dynarray(s_checkpoint *cp, const char *name, s_dynarray *arr)
+{
+    return checkpoint_register(cp, name, CHECKPOINT_DYNARRAY, arr, arr->item_size, 1);
+}
+
+static inline int checkpoint_register_random(s_checkpoint *cp, const char *name, int n, s_random_context ctx[n])
+{
+    return checkpoint_register(cp, name, CHECKPOINT_RANDOM, ctx, sizeof(s_random_context), n);
+}
+
+static inline int checkpoint_register_sample(s_checkpoint *cp, const char *name, s_sample *sample)
+{
+    return checkpoint_register(cp, name, CHECKPOINT_SAMPLE, sample, sizeof(s_sample), 1);
+}
+
+static inline int checkpoint_register_value(s_checkpoint *cp, const char *name, void *ptr, size_t size)
+{
+    return checkpoint_register(cp, name, CHECKPOINT_VALUE, ptr, size, 1);
+}
+
+
+static inline int checkpoint_io_all(MPI_File fh, bool write, MPI_Offset offset, void *buf, int64_t nbytes)
+{   /* Collective read/write of nbytes (may differ per rank) in pieces of at most MPIH_MAX_MESSAGE,
+     * same number of calls on every rank */
+    int64_t nio = (nbytes + MPIH_MAX_MESSAGE - 1) / MPIH_MAX_MESSAGE, max_io;
+    MPI_Allreduce(&nio, &max_io, 1, MPI_INT64_T, MPI_MAX, MPI_COMM_WORLD);
+    bool ok = true;
+    for (int64_t k = 0; k < max_io; k++) {
+        int64_t off = k * MPIH_MAX_MESSAGE;
+        int count = off >= nbytes ? 0 : (nbytes - off < MPIH_MAX_MESSAGE ? nbytes - off : MPIH_MAX_MESSAGE);
+        char *p = count ? (char*)buf + off : NULL;
+        int err = write ? MPI_File_write_at_all(fh, offset + off, p, count, MPI_BYTE, MPI_STATUS_IGNORE)
+                        : MPI_File_read_at_all(fh, offset + off, p, count, MPI_BYTE, MPI_STATUS_IGNORE);
+        if (err != MPI_SUCCESS) ok = false;
+    }
+    return ok;
+}
+
+static inline int64_t checkpoint_local_bytes(const s_checkpoint_entry *e, int rank)
+{
+    switch (e->kind) {
+        case CHECKPOINT_DYNARRAY: return (int64_t)((s_dynarray*)e->ptr)->N * e->item_size;
+        case CHECKPOINT_RANDOM:   return (int64_t)e->n * e->item_size;
+        case CHECKPOINT_SAMPLE:   return e->item_size;
+        case CHECKPOINT_VALUE:    return rank == 0 ? (int64_t)e->item_size : 0;
+    }
+    return 0;
+}
+
+static inline void *checkpoint_local_data(const s_checkpoint_entry *e)
+{
+    return e->kind == CHECKPOINT_DYNARRAY ? ((s_dynarray*)e->ptr)->items : e->ptr;
+}
+
+static inline int checkpoint_write(const s_checkpoint *cp, const char *path)
+{
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    const s_checkpoint_entry *entries = cp->entries.items;
+    char tmp[4096];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+        if (rank == 0) fprintf(stderr, "checkpoint_write: path too long.\n");
+        return 0;
+    }
+    int64_t *counts = rank == 0 ? malloc(size * sizeof(int64_t)) : NULL;
+    char *manifest = NULL;
+    size_t manifest_len = 0;
+    FILE *m = rank == 0 ? open_memstream(&manifest, &manifest_len) : NULL;
+    bool local_error = rank == 0 && (!counts || !m), global_error = false;
+    MPI_Allreduce(&local_error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) goto error;
+
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, tmp, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0) fprintf(stderr, "checkpoint_write: could not open '%s'.\n", tmp);
+        goto error;
+    }
+    if (MPI_File_set_size(fh, 0) != MPI_SUCCESS) local_error = true;
+    if (rank == 0) fprintf(m, "hlibs-checkpoint %d\nranks %d\nentries %u\n", CHECKPOINT_VERSION, size, cp->entries.N);
+
+    MPI_Offset offset = CHECKPOINT_HEADER;
+    for (unsigned i = 0; i < cp->entries.N; i++) {
+        const s_checkpoint_entry *e = &entries[i];
+        int64_t bytes = checkpoint_local_bytes(e, rank), before = 0, total;
+        MPI_Exscan(&bytes, &before, 1, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+        if (rank == 0) before = 0;  /* Exscan leaves it undefined on rank 0 */
+        MPI_Allreduce(&bytes, &total, 1, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+        int64_t items = bytes / e->item_size;
+        MPI_Gather(&items, 1, MPI_INT64_T, counts, 1, MPI_INT64_T, 0, MPI_COMM_WORLD);
+        if (!checkpoint_io_all(fh, true, offset + before, checkpoint_local_data(e), bytes)) local_error = true;
+        if (rank == 0) {
+            fprintf(m, "entry %s %d %zu %lld %lld\n", e->name, (int)e->kind, e->item_size, (long long)offset, (long long)total);
+            for (int r = 0; r < size; r++) fprintf(m, "%lld%c", (long long)counts[r], r == size - 1 ? '\n' : ' ');
+        }
+        offset += total;
+    }
+
+    /* Manifest and header, by rank 0 */
+    if (rank == 0) {
+        fclose(m);
+        m = NULL;
+        unsigned char header[CHECKPOINT_HEADER] = {0};
+        uint64_t fields[4] = { CHECKPOINT_VERSION, (uint64_t)size, (uint64_t)offset, manifest_len };
+        memcpy(header, CHECKPOINT_MAGIC, 8);
+        memcpy(header + 8, fields, sizeof(fields));
+        if (MPI_File_write_at(fh, 0, header, CHECKPOINT_HEADER, MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS) local_error = true;
+        for (size_t off = 0; off < manifest_len; off += MPIH_MAX_MESSAGE) {
+            int count = manifest_len - off < MPIH_MAX_MESSAGE ? manifest_len - off : MPIH_MAX_MESSAGE;
+            if (MPI_File_write_at(fh, offset + off, manifest + off, count, MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS) local_error = true;
+        }
+    }
+    /* On disk before the rename, or a crash could keep the new name with missing data */
+    if (MPI_File_sync(fh) != MPI_SUCCESS) local_error = true;
+    if (MPI_File_close(&fh) != MPI_SUCCESS) local_error = true;
+    MPI_Allreduce(&local_error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) {
+        if (rank == 0) fprintf(stderr, "checkpoint_write: could not write '%s'.\n", tmp);
+        goto error;
+    }
+    if (rank == 0 && rename(tmp, path) != 0) local_error = true;
+    MPI_Allreduce(&local_error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) {
+        if (rank == 0) fprintf(stderr, "checkpoint_write: could not rename '%s'.\n", tmp);
+        goto error;
+    }
+    free(counts);
+    free(manifest);
+    return 1;
+
+error:
+    if (m) fclose(m);
+    free(counts);
+    free(manifest);
+    return 0;
+}
+
+
+typedef struct checkpoint_saved {  /* Entry as read from the manifest */
+    char name[CHECKPOINT_NAME];
+    int kind;
+    size_t item_size;
+    int64_t offset, bytes;
+    int64_t *counts;  /* Items of each saved rank */
+} s_checkpoint_saved;
+
+static inline int checkpoint_parse(char *manifest, int64_t data_end, int *nranks, unsigned *nentries, s_checkpoint_saved **out)
+{   /* Parses the manifest (modified in place), out is malloc'd. Entries must lie in
+     * [CHECKPOINT_HEADER, data_end) and their counts must add up to their bytes. 0 if ERROR */
+    char *p = manifest, *end;
+    int version;
+    *out = NULL;
+    if (sscanf(p, "hlibs-checkpoint %d\nranks %d\nentries %u\n", &version, nranks, nentries) != 3 || *nranks < 1) return 0;
+    for (int k = 0; k < 3; k++) {
+        p = strchr(p, '\n');
+        if (!p) return 0;
+        p++;
+    }
+    size_t len = strlen(p);  /* Every entry and count takes at least one character */
+    if (*nentries > len || (size_t)*nranks > len) return 0;
+    s_checkpoint_saved *saved = calloc(*nentries + 1, sizeof(s_checkpoint_saved));
+    int64_t *counts = malloc((size_t)(*nentries + 1) * *nranks * sizeof(int64_t));
+    if (!saved || !counts) { free(saved); free(counts); return 0; }
+    for (unsigned i = 0; i < *nentries; i++) {
+        s_checkpoint_saved *s = &saved[i];
+        long long offset, bytes;
+        p += strspn(p, "\n");
+        if (sscanf(p, "entry %63s %d %zu %lld %lld", s->name, &s->kind, &s->item_size, &offset, &bytes) != 5) goto error;
+        if (s->kind < CHECKPOINT_DYNARRAY || s->kind > CHECKPOINT_VALUE || s->item_size == 0) goto error;
+        if (offset < CHECKPOINT_HEADER || bytes < 0 || bytes > data_end - offset) goto error;
+        if (s->kind == CHECKPOINT_SAMPLE && (s->item_size != sizeof(s_sample) || bytes != (int64_t)*nranks * (int64_t)sizeof(s_sample))) goto error;
+        s->offset = offset;
+        s->bytes = bytes;
+        s->counts = counts + (size_t)i * *nranks;
+        p = strchr(p, '\n');
+        if (!p) goto error;
+        int64_t left = bytes / (int64_t)s->item_size;  /* Items not yet claimed by a rank */
+        if (left * (int64_t)s->item_size != bytes) goto error;
+        for (int r = 0; r < *nranks; r++) {
+            s->counts[r] = strtoll(p, &end, 10);
+            if (end == p || s->counts[r] < 0 || s->counts[r] > left) goto error;
+            left -= s->counts[r];
+            p = end;
+        }
+        if (left != 0) goto error;
+    }
+    *out = saved;
+    return 1;
+
+error:
+    free(saved);
+    free(counts);
+    return 0;
+}
+
+static inline int checkpoint_read_entry(MPI_File fh, s_checkpoint_entry *e, const s_checkpoint_saved *s, int nranks)
+{   /* Collective. 0 if ERROR (on this rank) */
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    int64_t total = s->bytes / s->item_size;
+    bool ok = true;
+
+    if (e->kind == CHECKPOINT_DYNARRAY) {
+        s_dynarray *arr = e->ptr;
+        int64_t begin = 0, end = 0;
+        if (nranks == size) {
+            for (int r = 0; r < rank; r++) begin += s->counts[r];
+            end = begin + s->counts[rank];
+        } else {
+            s_MPIh_range range = MPIh_partition_block(rank, size, total);
+            begin = range.begin;
+            end = range.end;
+        }
+        if (!dynarray_ensure_capacity(arr, end - begin)) ok = false;
+        int64_t n = ok ? end - begin : 0;
+        ok = checkpoint_io_all(fh, false, s->offset + begin * s->item_size, arr->items, n * s->item_size) && ok;
+        arr->N = n;
+    } else if (e->kind == CHECKPOINT_RANDOM) {
+        /* Saved contexts of this rank: its own ones if the ranks did not change, otherwise 
+         * the next ones in global order. Contexts past them get the indices after total */
+        s_random_context *ctx = e->ptr, last;
+        int64_t n = e->n, first = 0, nsaved;
+        if (nranks == size) {
+            for (int r = 0; r < rank; r++) first += s->counts[r];
+            nsaved = s->counts[rank];
+        } else {
+            MPI_Exscan(&n, &first, 1, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+            if (rank == 0) first = 0;  /* Exscan leaves it undefined on rank 0 */
+            nsaved = first < total ? total - first : 0;
+        }
+        int64_t nread = nsaved < n ? nsaved : n, nderive = n - nread, derived = 0;
+        MPI_Exscan(&nderive, &derived, 1, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+        if (rank == 0) derived = 0;
+        ok = checkpoint_io_all(fh, false, s->offset + first * s->item_size, ctx, nread * s->item_size);
+        if (nderive > 0 && total == 0) ok = false;  /* Nothing to derive from */
+        ok = checkpoint_io_all(fh, false, s->offset + (total - 1) * s->item_size, &last, nderive > 0 && total > 0 ? s->item_size : 0) && ok;
+        /* Context total + derived + j is derived + j + 1 long jumps past the last saved one */
+        for (int64_t k = 0; k < derived && nderive > 0; k++) XOSHIRO256_long_jump(&last);
+        for (int64_t j = 0; j < nderive && total > 0; j++) {
+            XOSHIRO256_long_jump(&last);
+            ctx[nread + j] = last;
+            ctx[nread + j].stored_standard_normal = false;
+        }
+    } else if (e->kind == CHECKPOINT_SAMPLE) {
+        s_sample *sample = e->ptr;
+        if (nranks == size) {
+            ok = checkpoint_io_all(fh, false, s->offset + rank * s->item_size, sample, s->item_size);
+        } else {
+            s_sample *all = rank == 0 ? malloc(nranks * sizeof(s_sample)) : NULL;
+            if (rank == 0 && !all) ok = false;
+            ok = checkpoint_io_all(fh, false, s->offset, all, all ? s->bytes : 0) && ok;
+            *sample = stats_init_sample();
+            if (all) for (int r = 0; r < nranks; r++) *sample = stats_merge_samples(*sample, all[r]);
+            free(all);
+        }
+    } else {
+        ok = checkpoint_io_all(fh, false, s->offset, e->ptr, s->item_size);
+    }
+    return ok;
+}
+
+static inline int checkpoint_read(s_checkpoint *cp, const char *path)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0) fprintf(stderr, "checkpoint_read: could not open '%s'.\n", path);
+        return 0;
+    }
+
+    /* Rank 0 reads header and manifest, which every rank parses */
+    uint64_t fields[4] = {0};
+    bool local_error = false, global_error = false;
+    if (rank == 0) {
+        unsigned char header[CHECKPOINT_HEADER];
+        MPI_Offset file_size;
+        MPI_File_get_size(fh, &file_size);
+        if (file_size < CHECKPOINT_HEADER
+            || MPI_File_read_at(fh, 0, header, CHECKPOINT_HEADER, MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS
+            || memcmp(header, CHECKPOINT_MAGIC, 8) != 0) local_error = true;
+        else memcpy(fields, header + 8, sizeof(fields));
+        if (!local_error && (fields[0] != CHECKPOINT_VERSION || fields[2] > (uint64_t)file_size || fields[3] > (uint64_t)file_size - fields[2])) local_error = true;
+    }
+    MPI_Bcast(fields, 4, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    char *manifest = malloc(fields[3] + 1);
+    if (!manifest) local_error = true;
+    MPI_Allreduce(&local_error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error) {
+        if (rank == 0) fprintf(stderr, "checkpoint_read: '%s' is not a valid checkpoint.\n", path);
+        free(manifest);
+        MPI_File_close(&fh);
+        return 0;
+    }
+    if (rank == 0) {
+        for (uint64_t off = 0; off < fields[3]; off += MPIH_MAX_MESSAGE) {
+            int count = fields[3] - off < MPIH_MAX_MESSAGE ? fields[3] - off : MPIH_MAX_MESSAGE;
+            if (MPI_File_read_at(fh, fields[2] + off, manifest + off, count, MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS) local_error = true;
+        }
+    }
+    MPI_Allreduce(&local_error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error || !MPIh_bcast_large(manifest, fields[3], MPI_BYTE, 0)) {
+        if (rank == 0) fprintf(stderr, "checkpoint_read: could not read the manifest of '%s'.\n", path);
+        free(manifest);
+        MPI_File_close(&fh);
+        return 0;
+    }
+    manifest[fields[3]] = '\0';
+
+    int nranks;
+    unsigned nentries;
+    s_checkpoint_saved *saved = NULL;
+    if (!checkpoint_parse(manifest, (int64_t)fields[2], &nranks, &nentries, &saved)) {
+        if (rank == 0) fprintf(stderr, "checkpoint_read: corrupt manifest in '%s'.\n", path);
+        free(manifest);
+        MPI_File_close(&fh);
+        return 0;
+    }
+
+    /* Registered entries, matched by name: checked first, so every rank does the same reads */
+    s_checkpoint_entry *entries = cp->entries.items;
+    for (unsigned i = 0; i < cp->entries.N; i++) {
+        unsigned k = 0;
+        while (k < nentries && strcmp(saved[k].name, entries[i].name) != 0) k++;
+        if (k == nentries || saved[k].kind != (int)entries[i].kind || saved[k].item_size != entries[i].item_size) {
+            if (rank == 0) fprintf(stderr, "checkpoint_read: '%s' is missing or does not match in '%s'.\n", entries[i].name, path);
+            local_error = true;
+        }
+    }
+    /* The check agrees on every rank; read failures do not, so every rank reads every entry */
+    bool matched = !local_error;
+    for (unsigned i = 0; i < cp->entries.N && matched; i++) {
+        unsigned k = 0;
+        while (strcmp(saved[k].name, entries[i].name) != 0) k++;
+        if (!checkpoint_read_entry(fh, &entries[i], &saved[k], nranks)) local_error = true;
+    }
+    MPI_File_close(&fh);
+    MPI_Allreduce(&local_error, &global_error, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+    if (global_error && rank == 0) fprintf(stderr, "checkpoint_read: could not restore from '%s'.\n", path);
+    if (saved) free(saved[0].counts);
+    free(saved);
+    free(manifest);
+    return !global_error;
+}
+
+#endif
+
+/* MIT License.
+ *
+ * Copyright (c) 2026 Fernando Muñoz.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
@@ -1,5 +1,13 @@
 /* 
  * Header-only file management helpers.
+ * Besides plain text helpers, provides a self-describing binary columnar format
+ * (colfile): named, typed columns stored in fixed-size row chunks, each column 
+ * block protected by a CRC32C, with an index footer. Files are read through mmap, 
+ * so single columns or row ranges can be read without touching the rest.
+ * Blocks can optionally be compressed with a built-in LZ compressor (LZ4 block 
+ * format), after delta and byte-shuffle filters suited to floating-point data.
+ * With OpenMP, blocks are compressed and decompressed in parallel.
+ * Asynchronous I/O and the tail-follow reader are in files_async.h.
  * 
  * Copyright (c) 2026 Fernando Muñoz
  * MIT license. See bottom of file.
@@ -8,9 +16,142 @@
 
 #ifndef HLIBS_FILES_H
 #define HLIBS_FILES_H
+#if !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200809L  /* mmap, pread, fstat with plain -std=c11 */
+#endif
 
 #include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include "dynarray.h"
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+/* Binary columnar file layout (all fields in the writer's byte order, recorded by endian_tag):
+ *   [ header ][ column descriptors ][ chunk 0 ][ chunk 1 ] ... [ index ][ footer ]
+ * A chunk holds chunk_rows rows (last one may be shorter), stored column after column.
+ * Each column block is padded to 8 bytes, so mmapped doubles and int64s are aligned.
+ * The index has one entry per (chunk, column), ordered by chunk then column.
+ * Blocks record the filters applied to them, in the order DELTA, SHUFFLE, LZ. Blocks that 
+ * do not shrink are stored without LZ.
+ */
+#define COLFILE_MAGIC "HLCF"
+#define COLFILE_VERSION 2  /* Version 1 files (no filters) can still be read */
+#define COLFILE_ENDIAN_TAG 0x01020304u
+#define COLFILE_NAME_MAX 32
+#define COLFILE_DEFAULT_CHUNK_ROWS 65536  /* User can change this */
+
+typedef enum {
+    COLFILE_INT32,
+    COLFILE_INT64,
+    COLFILE_UINT64,
+    COLFILE_FLOAT,
+    COLFILE_DOUBLE,
+} e_colfile_type;
+
+#define COLFILE_FILTER_LZ      1u  /* LZ77 compression */
+#define COLFILE_FILTER_SHUFFLE 2u  /* Transposes bytes, so bytes of equal significance are contiguous */
+#define COLFILE_FILTER_DELTA   4u  /* Differences of consecutive values, on their bit patterns */
+#define COLFILE_FILTER_FLOATS  (COLFILE_FILTER_LZ | COLFILE_FILTER_SHUFFLE | COLFILE_FILTER_DELTA)  /* Good default for smooth series */
+
+typedef struct colfile_header {  /* On disk, 32 bytes */
+    char magic[4];
+    uint32_t version;
+    uint32_t endian_tag;
+    uint32_t ncols;
+    uint64_t nrows;
+    uint32_t chunk_rows;
+    uint32_t nchunks;
+} s_colfile_header;
+
+typedef struct colfile_column {  /* On disk, 40 bytes */
+    char name[COLFILE_NAME_MAX];  /* Null-terminated */
+    uint32_t type;                /* e_colfile_type */
+    uint32_t elem_size;
+} s_colfile_column;
+
+typedef struct colfile_block {  /* On disk, 24 bytes. Index entry of one column inside one chunk */
+    uint64_t offset;
+    uint64_t size;  /* Bytes, without padding */
+    uint32_t crc;   /* CRC32C of the stored bytes */
+    uint32_t filters;  /* COLFILE_FILTER_* applied to this block (0 in version 1) */
+} s_colfile_block;
+
+typedef struct colfile_footer {  /* On disk, 16 bytes */
+    uint64_t index_offset;
+    uint32_t index_crc;
+    char magic[4];
+} s_colfile_footer;
+
+
+typedef struct colfile_writer {
+    FILE *file;
+    uint32_t ncols;
+    uint32_t chunk_rows;
+    uint32_t filters;     /* COLFILE_FILTER_* flags */
+    uint32_t nbatch;      /* Chunks buffered before being encoded (in parallel) and written */
+    uint32_t nfull;       /* Full chunks currently buffered */
+    s_colfile_column *columns;
+    void **buffers;       /* nbatch chunks of rows. Block of chunk k, column c: buffers[k*ncols + c] */
+    void **packed;        /* Same layout, encoding space. NULL without filters */
+    uint32_t nbuffered;   /* Rows in the chunk being filled */
+    uint64_t nrows;
+    uint64_t offset;      /* Current end of file */
+    s_dynarray index;     /* s_colfile_block entries */
+    bool failed;          /* Sticky, set by the first failed flush: later appends and close fail */
+} s_colfile_writer;
 
+typedef struct colfile {  /* Reader */
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    s_colfile_header header;
+    s_colfile_column *columns;
+    s_colfile_block *index;  /* nchunks * ncols entries */
+    uint8_t *verified;       /* Per block: 0 not checked yet, 1 CRC OK */
+    bool swap;               /* File written with the other byte order */
+} s_colfile;
+
+
+/* INTERFACE */
+/* All functions returning int, return 0 on ERROR, 1 on SUCCESS (unless stated otherwise). */
+static inline int count_lines(FILE *file);  /* -1 if ERROR. Rewinds the file */
+static inline uint32_t files_crc32c(uint32_t crc, const void *data, size_t n);  /* Start with crc = 0 */
+static inline size_t files_lz_bound(size_t n);  /* Worst-case compressed size */
+static inline size_t files_lz_compress(const void *src, size_t n, void *dst, size_t cap);  /* Compressed size, 0 if it does not fit in cap */
+static inline int files_lz_decompress(const void *src, size_t n, void *dst, size_t out_n);  /* 1 only if exactly out_n bytes are produced */
+
+static inline int colfile_writer_open(s_colfile_writer *w, const char *path, int ncols, const char *const names[ncols], const e_colfile_type types[ncols], uint32_t chunk_rows);  /* chunk_rows = 0 for default */
+static inline int colfile_writer_set_filters(s_colfile_writer *w, uint32_t filters, uint32_t nbatch);  /* Before appending. nbatch = 0: one chunk per OpenMP thread */
+static inline int colfile_writer_append(s_colfile_writer *w, size_t nrows, const void *const columns[]);  /* columns[c] points to nrows values of column c */
+static inline int colfile_writer_close(s_colfile_writer *w);  /* Writes index and footer. Always frees w */
+
+static inline int colfile_open(s_colfile *f, const char *path);
+static inline void colfile_close(s_colfile *f);
+static inline int colfile_find_column(const s_colfile *f, const char *name);  /* -1 if NOT FOUND */
+static inline int colfile_read(s_colfile *f, int col, uint64_t row_begin, uint64_t row_end, void *out);  /* Rows [begin, end), stored type. 0 if ERROR or bad CRC */
+static inline int colfile_read_double(s_colfile *f, int col, uint64_t row_begin, uint64_t row_end, double *out);  /* Same, converted to double */
+static inline const void *colfile_chunk_ptr(s_colfile *f, int col, uint32_t chunk, uint32_t *nrows);  /* Zero-copy. NULL if ERROR, bad CRC, filtered block or foreign byte order */
+
+static inline int colfile_from_text(const char *txt_path, const char *bin_path, int ncols, const char *const names[], const e_colfile_type types[], uint32_t chunk_rows);  /* See below */
+static inline int colfile_to_text(const char *bin_path, const char *txt_path);
+
+
+
+
+/* IMPLEMENTATION */
 static inline int count_lines(FILE *file)
 {
     const int BUF_SIZE = 2048;
@@ -31,6 +172,867 @@ static inline int count_lines(FILE *file)
     return counter;
 }
 
+
+static const uint32_t FILES_CRC32C_TABLE[256] = {  /* Castagnoli polynomial, reflected 0x82F63B78 */
+    0x00000000u, 0xf26b8303u, 0xe13b70f7u, 0x1350f3f4u, 0xc79a971fu, 0x35f1141cu,
+    0x26a1e7e8u, 0xd4ca64ebu, 0x8ad958cfu, 0x78b2dbccu, 0x6be22838u, 0x9989ab3bu,
+    0x4d43cfd0u, 0xbf284cd3u, 0xac78bf27u, 0x5e133c24u, 0x105ec76fu, 0xe235446cu,
+    0xf165b798u, 0x030e349bu, 0xd7c45070u, 0x25afd373u, 0x36ff2087u, 0xc494a384u,
+    0x9a879fa0u, 0x68ec1ca3u, 0x7bbcef57u, 0x89d76c54u, 0x5d1d08bfu, 0xaf768bbcu,
+    0xbc267848u, 0x4e4dfb4bu, 0x20bd8edeu, 0xd2d60dddu, 0xc186fe29u, 0x33ed7d2au,
+    0xe72719c1u, 0x154c9ac2u, 0x061c6936u, 0xf477ea35u, 0xaa64d611u, 0x580f5512u,
+    0x4b5fa6e6u, 0xb93425e5u, 0x6dfe410eu, 0x9f95c20du, 0x8cc531f9u, 0x7eaeb2fau,
+    0x30e349b1u, 0xc288cab2u, 0xd1d83946u, 0x23b3ba45u, 0xf779deaeu, 0x05125dadu,
+    0x1642ae59u, 0xe4292d5au, 0xba3a117eu, 0x4851927du, 0x5b016189u, 0xa96ae28au,
+    0x7da08661u, 0x8fcb0562u, 0x9c9bf696u, 0x6ef07595u, 0x417b1dbcu, 0xb3109ebfu,
+    0xa0406d4bu, 0x522bee48u, 0x86e18aa3u, 0x748a09a0u, 0x67dafa54u, 0x95b17957u,
+    0xcba24573u, 0x39c9c670u, 0x2a993584u, 0xd8f2b687u, 0x0c38d26cu, 0xfe53516fu,
+    0xed03a29bu, 0x1f682198u, 0x5125dad3u, 0xa34e59d0u, 0xb01eaa24u, 0x42752927u,
+    0x96bf4dccu, 0x64d4cecfu, 0x77843d3bu, 0x85efbe38u, 0xdbfc821cu, 0x2997011fu,
+    0x3ac7f2ebu, 0xc8ac71e8u, 0x1c661503u, 0xee0d9600u, 0xfd5d65f4u, 0x0f36e6f7u,
+    0x61c69362u, 0x93ad1061u, 0x80fde395u, 0x72966096u, 0xa65c047du, 0x5437877eu,
+    0x4767748au, 0xb50cf789u, 0xeb1fcbadu, 0x197448aeu, 0x0a24bb5au, 0xf84f3859u,
+    0x2c855cb2u, 0xdeeedfb1u, 0xcdbe2c45u, 0x3fd5af46u, 0x7198540du, 0x83f3d70eu,
+    0x90a324fau, 0x62c8a7f9u, 0xb602c312u, 0x44694011u, 0x5739b3e5u, 0xa55230e6u,
+    0xfb410cc2u, 0x092a8fc1u, 0x1a7a7c35u, 0xe811ff36u, 0x3cdb9bddu, 0xceb018deu,
+    0xdde0eb2au, 0x2f8b6829u, 0x82f63b78u, 0x709db87bu, 0x63cd4b8fu, 0x91a6c88cu,
+    0x456cac67u, 0xb7072f64u, 0xa457dc90u, 0x563c5f93u, 0x082f63b7u, 0xfa44e0b4u,
+    0xe9141340u, 0x1b7f9043u, 0xcfb5f4a8u, 0x3dde77abu, 0x2e8e845fu, 0xdce5075cu,
+    0x92a8fc17u, 0x60c37f14u, 0x73938ce0u, 0x81f80fe3u, 0x55326b08u, 0xa759e80bu,
+    0xb4091bffu, 0x466298fcu, 0x1871a4d8u, 0xea1a27dbu, 0xf94ad42fu, 0x0b21572cu,
+    0xdfeb33c7u, 0x2d80b0c4u, 0x3ed04330u, 0xccbbc033u, 0xa24bb5a6u, 0x502036a5u,
+    0x4370c551u, 0xb11b4652u, 0x65d122b9u, 0x97baa1bau, 0x84ea524eu, 0x7681d14du,
+    0x2892ed69u, 0xdaf96e6au, 0xc9a99d9eu, 0x3bc21e9du, 0xef087a76u, 0x1d63f975u,
+    0x0e330a81u, 0xfc588982u, 0xb21572c9u, 0x407ef1cau, 0x532e023eu, 0xa145813du,
+    0x758fe5d6u, 0x87e466d5u, 0x94b49521u, 0x66df1622u, 0x38cc2a06u, 0xcaa7a905u,
+    0xd9f75af1u, 0x2b9cd9f2u, 0xff56bd19u, 0x0d3d3e1au, 0x1e6dcdeeu, 0xec064eedu,
+    0xc38d26c4u, 0x31e6a5c7u, 0x22b65633u, 0xd0ddd530u, 0x0417b1dbu, 0xf67c32d8u,
+    0xe52cc12cu, 0x1747422fu, 0x49547e0bu, 0xbb3ffd08u, 0xa86f0efcu, 0x5a048dffu,
+    0x8ecee914u, 0x7ca56a17u, 0x6ff599e3u, 0x9d9e1ae0u, 0xd3d3e1abu, 0x21b862a8u,
+    0x32e8915cu, 0xc083125fu, 0x144976b4u, 0xe622f5b7u, 0xf5720643u, 0x07198540u,
+    0x590ab964u, 0xab613a67u, 0xb831c993u, 0x4a5a4a90u, 0x9e902e7bu, 0x6cfbad78u,
+    0x7fab5e8cu, 0x8dc0dd8fu, 0xe330a81au, 0x115b2b19u, 0x020bd8edu, 0xf0605beeu,
+    0x24aa3f05u, 0xd6c1bc06u, 0xc5914ff2u, 0x37faccf1u, 0x69e9f0d5u, 0x9b8273d6u,
+    0x88d28022u, 0x7ab90321u, 0xae7367cau, 0x5c18e4c9u, 0x4f48173du, 0xbd23943eu,
+    0xf36e6f75u, 0x0105ec76u, 0x12551f82u, 0xe03e9c81u, 0x34f4f86au, 0xc69f7b69u,
+    0xd5cf889du, 0x27a40b9eu, 0x79b737bau, 0x8bdcb4b9u, 0x988c474du, 0x6ae7c44eu,
+    0xbe2da0a5u, 0x4c4623a6u, 0x5f16d052u, 0xad7d5351u
+};
+
+static inline uint32_t files_crc32c(uint32_t crc, const void *data, size_t n)
+{   /* Uses the SSE4.2 crc32 instruction when compiled for it, table-driven otherwise */
+    const uint8_t *p = data;
+    crc = ~crc;
+#if defined(__SSE4_2__)
+    uint64_t c = crc;
+    while (n >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+        p += 8; n -= 8;
+    }
+    crc = (uint32_t)c;
+    while (n--) crc = _mm_crc32_u8(crc, *p++);
+#else
+    while (n--) crc = FILES_CRC32C_TABLE[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+#endif
+    return ~crc;
+}
+
+
+static inline size_t colfile_type_size(e_colfile_type type)
+{
+    switch (type) {
+        case COLFILE_INT32: case COLFILE_FLOAT: return 4;
+        case COLFILE_INT64: case COLFILE_UINT64: case COLFILE_DOUBLE: return 8;
+    }
+    return 0;
+}
+
+static inline size_t colfile_pad8(size_t x)
+{
+    return (x + 7) & ~(size_t)7;
+}
+
+static inline void colfile_bswap(void *data, size_t elem_size, size_t n)
+{   /* In-place byte order reversal of n elements */
+    uint8_t *p = data;
+    for (size_t i = 0; i < n; i++, p += elem_size) {
+        for (size_t a = 0, b = elem_size - 1; a < b; a++, b--) {
+            uint8_t t = p[a]; p[a] = p[b]; p[b] = t;
+        }
+    }
+}
+
+
+
+
+/* LZ compressor. Output follows the LZ4 block format: sequences of
+ * [token][literal length+][literals][offset (2 bytes LE)][match length+], 
+ * and the last sequence only has literals. Matches are found through a single 
+ * hash table of 4-byte sequences, which skips faster over incompressible data. */
+#define FILES_LZ_HASH_LOG 14
+#define FILES_LZ_MIN_MATCH 4
+#define FILES_LZ_LAST_LITERALS 5  /* Bytes at the end that are always literals */
+#define FILES_LZ_MATCH_LIMIT 12   /* No match starts in the last bytes */
+
+static inline uint32_t files_read32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64_t files_read64(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+
+static inline size_t files_lz_bound(size_t n)
+{
+    return n + n / 255 + 16;
+}
+
+static inline size_t files_lz_write_length(uint8_t *dst, size_t len)
+{   /* Continuation bytes of a length >= 15 */
+    size_t op = 0;
+    for (len -= 15; len >= 255; len -= 255) dst[op++] = 255;
+    dst[op++] = (uint8_t)len;
+    return op;
+}
+
+static inline size_t files_lz_compress(const void *src_, size_t n, void *dst_, size_t cap)
+{
+    const uint8_t *src = src_;
+    uint8_t *dst = dst_;
+    uint32_t table[1 << FILES_LZ_HASH_LOG];  /* Last position of each hashed 4-byte sequence */
+    memset(table, 0, sizeof(table));
+
+    size_t ip = 0, anchor = 0, op = 0;
+    if (n > FILES_LZ_MATCH_LIMIT) {
+        const size_t match_limit = n - FILES_LZ_MATCH_LIMIT;
+        const size_t extend_limit = n - FILES_LZ_LAST_LITERALS;
+        ip = 1;
+        while (ip < match_limit) {
+            uint32_t seq = files_read32(src + ip);
+            uint32_t h = (seq * 2654435761u) >> (32 - FILES_LZ_HASH_LOG);
+            size_t ref = table[h];
+            table[h] = (uint32_t)ip;
+            if (ip - ref > 65535 || files_read32(src + ref) != seq) {
+                ip += 1 + ((ip - anchor) >> 6);  /* Accelerate on incompressible data */
+                continue;
+            }
+
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) { ip--; ref--; }
+            size_t len = FILES_LZ_MIN_MATCH;
+            while (ip + len + 8 <= extend_limit) {
+                uint64_t diff = files_read64(src + ip + len) ^ files_read64(src + ref + len);
+                if (diff) { len += __builtin_ctzll(diff) >> 3; goto match_found; }
+                len += 8;
+            }
+            while (ip + len < extend_limit && src[ip + len] == src[ref + len]) len++;
+        match_found:;
+
+            size_t lit = ip - anchor;
+            if (op + 1 + lit / 255 + 1 + lit + 2 + (len - FILES_LZ_MIN_MATCH) / 255 + 1 > cap) return 0;
+            size_t ml = len - FILES_LZ_MIN_MATCH;
+            uint8_t *token = &dst[op++];
+            *token = (uint8_t)(((lit < 15 ? lit : 15) << 4) | (ml < 15 ? ml : 15));
+            if (lit >= 15) op += files_lz_write_length(dst + op, lit);
+            memcpy(dst + op, src + anchor, lit);
+            op += lit;
+            size_t offset = ip - ref;
+            dst[op++] = (uint8_t)offset;
+            dst[op++] = (uint8_t)(offset >> 8);
+            if (ml >= 15) op += files_lz_write_length(dst + op, ml);
+
+            ip += len;
+            anchor = ip;
+        }
+    }
+
+    size_t lit = n - anchor;
+    if (op + 1 + lit / 255 + 1 + lit > cap) return 0;
+    dst[op++] = (uint8_t)((lit < 15 ? lit : 15) << 4);
+    if (lit >= 15) op += files_lz_write_length(dst + op, lit);
+    memcpy(dst + op, src + anchor, lit);
+    return op + lit;
+}
+
+static inline int files_lz_decompress(const void *src_, size_t n, void *dst_, size_t out_n)
+{   /* Checks every bound, so corrupted input cannot write out of dst */
+    const uint8_t *src = src_;
+    uint8_t *dst = dst_;
+    size_t ip = 0, op = 0;
+    while (ip < n) {
+        uint8_t token = src[ip++];
+        size_t lit = token >> 4;
+        if (lit == 15) {
+            uint8_t b;
+            do { if (ip >= n) return 0; b = src[ip++]; lit += b; } while (b == 255);
+        }
+        if (lit > n - ip || lit > out_n - op) return 0;
+        memcpy(dst + op, src + ip, lit);
+        ip += lit; op += lit;
+        if (ip == n) break;  /* Last sequence */
+
+        if (n - ip < 2) return 0;
+        size_t offset = src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return 0;
+        size_t len = token & 15;
+        if (len == 15) {
+            uint8_t b;
+            do { if (ip >= n) return 0; b = src[ip++]; len += b; } while (b == 255);
+        }
+        len += FILES_LZ_MIN_MATCH;
+        if (len > out_n - op) return 0;
+
+        uint8_t *d = dst + op;
+        const uint8_t *s = d - offset;
+        if (offset >= len) memcpy(d, s, len);
+        else for (size_t i = 0; i < len; i++) d[i] = s[i];  /* Overlapping: repeats the pattern */
+        op += len;
+    }
+    return op == out_n;
+}
+
+
+/* Pre-filters for numeric blocks. Delta works on the bit patterns as unsigned integers, 
+ * so it is exactly reversible; for smooth floating-point series it zeroes most high bytes, 
+ * which the shuffle then groups together for the compressor. */
+static inline void files_delta_encode(void *data, size_t n, size_t elem_size)
+{
+    if (elem_size == 8) {
+        uint64_t *v = data;
+        for (size_t i = n; i-- > 1;) v[i] -= v[i-1];
+    } else if (elem_size == 4) {
+        uint32_t *v = data;
+        for (size_t i = n; i-- > 1;) v[i] -= v[i-1];
+    }
+}
+
+static inline void files_delta_decode(void *data, size_t n, size_t elem_size)
+{
+    if (elem_size == 8) {
+        uint64_t *v = data;
+        for (size_t i = 1; i < n; i++) v[i] += v[i-1];
+    } else if (elem_size == 4) {
+        uint32_t *v = data;
+        for (size_t i = 1; i < n; i++) v[i] += v[i-1];
+    }
+}
+
+static inline void files_shuffle(const void *src, void *dst, size_t n, size_t elem_size)
+{   /* dst[b*n + i] = byte b of element i */
+    const uint8_t *s = src;
+    uint8_t *d = dst;
+    for (size_t b = 0; b < elem_size; b++)
+        for (size_t i = 0; i < n; i++) d[b*n + i] = s[i*elem_size + b];
+}
+
+static inline void files_unshuffle(const void *src, void *dst, size_t n, size_t elem_size)
+{
+    const uint8_t *s = src;
+    uint8_t *d = dst;
+    for (size_t b = 0; b < elem_size; b++)
+        for (size_t i = 0; i < n; i++) d[i*elem_size + b] = s[b*n + i];
+}
+
+
+
+
+static inline void colfile_writer_free_batch(s_colfile_writer *w)
+{
+    size_t nblocks = (size_t)w->nbatch * w->ncols;
+    for (size_t i = 0; i < nblocks; i++) {
+        if (w->buffers) free(w->buffers[i]);
+        if (w->packed) free(w->packed[i]);
+    }
+    free(w->buffers);
+    free(w->packed);
+    w->buffers = w->packed = NULL;
+    w->nbatch = 0;
+}
+
+static inline int colfile_writer_alloc_batch(s_colfile_writer *w, uint32_t nbatch, bool packed)
+{   /* (Re)allocates the chunk buffers. Buffered rows are lost. If ERROR, the writer has no batch */
+    colfile_writer_free_batch(w);
+    if (nbatch == 0) return 1;
+
+    size_t nblocks = (size_t)nbatch * w->ncols;
+    w->buffers = calloc(nblocks, sizeof(void*));
+    if (packed) w->packed = calloc(nblocks, sizeof(void*));
+    w->nbatch = nbatch;
+    if (!w->buffers || (packed && !w->packed)) goto error;
+
+    for (size_t i = 0; i < nblocks; i++) {
+        size_t size = (size_t)w->chunk_rows * w->columns[i % w->ncols].elem_size;
+        w->buffers[i] = malloc(size);
+        if (!w->buffers[i]) goto error;
+        if (packed) {
+            w->packed[i] = malloc(files_lz_bound(size));
+            if (!w->packed[i]) goto error;
+        }
+    }
+    return 1;
+
+error:
+    colfile_writer_free_batch(w);
+    return 0;
+}
+
+static inline int colfile_writer_open(s_colfile_writer *w, const char *path, int ncols, const char *const names[ncols], const e_colfile_type types[ncols], uint32_t chunk_rows)
+{
+    memset(w, 0, sizeof(*w));
+    if (ncols <= 0) { fprintf(stderr, "colfile_writer_open: ncols needs to be >= 1.\n"); return 0; }
+    if (chunk_rows == 0) chunk_rows = COLFILE_DEFAULT_CHUNK_ROWS;
+
+    w->ncols = ncols;
+    w->chunk_rows = chunk_rows;
+    w->columns = calloc(ncols, sizeof(s_colfile_column));
+    w->index = dynarray_initialize(sizeof(s_colfile_block), 0);
+    if (!w->columns || !w->index.items) goto error;
+
+    for (int c = 0; c < ncols; c++) {
+        if (strlen(names[c]) >= COLFILE_NAME_MAX) {
+            fprintf(stderr, "colfile_writer_open: column name '%s' too long.\n", names[c]);
+            goto error;
+        }
+        strcpy(w->columns[c].name, names[c]);
+        w->columns[c].type = types[c];
+        w->columns[c].elem_size = colfile_type_size(types[c]);
+        if (w->columns[c].elem_size == 0) { fprintf(stderr, "colfile_writer_open: unknown type.\n"); goto error; }
+    }
+    if (!colfile_writer_alloc_batch(w, 1, false)) goto error;
+
+    w->file = fopen(path, "wb");
+    if (!w->file) { fprintf(stderr, "colfile_writer_open: could not open '%s'.\n", path); goto error; }
+
+    /* Header is patched with the final row count on close */
+    s_colfile_header h = { .version = COLFILE_VERSION, .endian_tag = COLFILE_ENDIAN_TAG, 
+                           .ncols = ncols, .chunk_rows = chunk_rows };
+    memcpy(h.magic, COLFILE_MAGIC, 4);
+    if (fwrite(&h, sizeof(h), 1, w->file) != 1) goto error;
+    if (fwrite(w->columns, sizeof(s_colfile_column), ncols, w->file) != (size_t)ncols) goto error;
+    w->offset = sizeof(h) + ncols * sizeof(s_colfile_column);
+    return 1;
+
+error:
+    if (w->file) fclose(w->file);
+    w->file = NULL;
+    colfile_writer_close(w);
+    return 0;
+}
+
+static inline int colfile_writer_set_filters(s_colfile_writer *w, uint32_t filters, uint32_t nbatch)
+{
+    if (!w || !w->file) return 0;
+    if (w->nrows > 0) { fprintf(stderr, "colfile_writer_set_filters: rows already appended.\n"); return 0; }
+    if (filters & ~COLFILE_FILTER_FLOATS) { fprintf(stderr, "colfile_writer_set_filters: unknown filter.\n"); return 0; }
+    if (nbatch == 0) {
+#ifdef _OPENMP
+        nbatch = omp_get_max_threads();
+#else
+        nbatch = 1;
+#endif
+    }
+    w->filters = filters;
+    if (!colfile_writer_alloc_batch(w, nbatch, filters != 0)) {
+        fprintf(stderr, "colfile_writer_set_filters: out of memory.\n");
+        w->filters = 0;  /* Fall back to the single unfiltered chunk of colfile_writer_open */
+        colfile_writer_alloc_batch(w, 1, false);
+        return 0;
+    }
+    return 1;
+}
+
+static inline const void *colfile_encode_block(void *a, void *b, size_t size, size_t elem_size, uint32_t filters, uint64_t *stored_size, uint32_t *stored_filters)
+{   /* Encodes raw bytes in a, using b (files_lz_bound(size) bytes) as scratch. Both are overwritten.
+     * Returns whichever of them holds the result. */
+    void *cur = a, *other = b, *tmp;
+    size_t n = size / elem_size;
+    uint32_t applied = 0;
+    *stored_size = size;
+
+    if (filters & COLFILE_FILTER_DELTA) {
+        files_delta_encode(cur, n, elem_size);
+        applied |= COLFILE_FILTER_DELTA;
+    }
+    if (filters & COLFILE_FILTER_SHUFFLE) {
+        files_shuffle(cur, other, n, elem_size);
+        tmp = cur; cur = other; other = tmp;
+        applied |= COLFILE_FILTER_SHUFFLE;
+    }
+    if (filters & COLFILE_FILTER_LZ) {  /* Keep only if it shrinks. a only has room for size bytes */
+        size_t packed = files_lz_compress(cur, size, other, size - 1);
+        if (packed > 0) {
+            tmp = cur; cur = other; other = tmp;
+            applied |= COLFILE_FILTER_LZ;
+            *stored_size = packed;
+        }
+    }
+    *stored_filters = applied;
+    return cur;
+}
+
+static inline int colfile_writer_flush(s_colfile_writer *w)
+{   /* Encodes all buffered chunks (in parallel) and writes them, padded to 8 bytes, in order.
+     * The buffers are emptied even if ERROR, which marks the writer as failed */
+    static const uint8_t zeros[8] = {0};
+    if (w->failed) return 0;
+    uint32_t nchunks = w->nfull + (w->nbuffered > 0);
+    size_t nblocks = (size_t)nchunks * w->ncols;
+    if (nblocks == 0) return 1;
+    uint32_t last_rows = w->nbuffered > 0 ? w->nbuffered : w->chunk_rows;
+    w->nfull = 0;
+    w->nbuffered = 0;
+
+    s_colfile_block *blocks = malloc(nblocks * sizeof(s_colfile_block));
+    const void **data = malloc(nblocks * sizeof(void*));
+    if (!blocks || !data) {
+        free(blocks); free(data);
+        w->failed = true;
+        return 0;
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) if (w->filters && nblocks > 1)
+#endif
+    for (long i = 0; i < (long)nblocks; i++) {
+        size_t es = w->columns[i % w->ncols].elem_size;
+        size_t rows = (size_t)i / w->ncols == nchunks - 1 ? last_rows : w->chunk_rows;
+        size_t size = rows * es;
+        blocks[i] = (s_colfile_block){ .size = size };
+        data[i] = w->buffers[i];
+        if (w->filters) data[i] = colfile_encode_block(w->buffers[i], w->packed[i], size, es, w->filters, &blocks[i].size, &blocks[i].filters);
+        blocks[i].crc = files_crc32c(0, data[i], blocks[i].size);
+    }
+
+    int ok = 1;
+    for (size_t i = 0; ok && i < nblocks; i++) {
+        size_t size = blocks[i].size, padded = colfile_pad8(size);
+        blocks[i].offset = w->offset;
+        ok = fwrite(data[i], 1, size, w->file) == size 
+          && fwrite(zeros, 1, padded - size, w->file) == padded - size
+          && dynarray_push(&w->index, &blocks[i]);
+        if (ok) w->offset += padded;
+    }
+    if (!ok) w->failed = true;
+    free(blocks);
+    free(data);
+    return ok;
+}
+
+static inline int colfile_writer_append(s_colfile_writer *w, size_t nrows, const void *const columns[])
+{
+    if (!w || !w->file || w->failed) return 0;
+    if (w->nbatch == 0) { fprintf(stderr, "colfile_writer_append: writer has no chunk buffers.\n"); return 0; }
+    size_t done = 0;
+    while (done < nrows) {
+        size_t take = w->chunk_rows - w->nbuffered;
+        if (take > nrows - done) take = nrows - done;
+
+        for (uint32_t c = 0; c < w->ncols; c++) {
+            size_t es = w->columns[c].elem_size;
+            void *dst = (uint8_t*)w->buffers[(size_t)w->nfull * w->ncols + c] + w->nbuffered * es;
+            memcpy(dst, (const uint8_t*)columns[c] + done * es, take * es);
+        }
+        w->nbuffered += take;
+        w->nrows += take;
+        done += take;
+
+        if (w->nbuffered == w->chunk_rows) {
+            w->nfull++;
+            w->nbuffered = 0;
+            if (w->nfull == w->nbatch && !colfile_writer_flush(w)) {
+                fprintf(stderr, "colfile_writer_append: write failed.\n");
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static inline int colfile_writer_close(s_colfile_writer *w)
+{
+    if (!w) return 0;
+    int ok = w->file != NULL && !w->failed;
+
+    if (ok) ok = colfile_writer_flush(w);
+    if (ok) {
+        s_colfile_footer footer = { .index_offset = w->offset, 
+                                    .index_crc = files_crc32c(0, w->index.items, w->index.N * sizeof(s_colfile_block)) };
+        memcpy(footer.magic, COLFILE_MAGIC, 4);
+        ok = fwrite(w->index.items, sizeof(s_colfile_block), w->index.N, w->file) == w->index.N 
+          && fwrite(&footer, sizeof(footer), 1, w->file) == 1;
+    }
+    if (ok) {
+        s_colfile_header h = { .version = COLFILE_VERSION, .endian_tag = COLFILE_ENDIAN_TAG, .ncols = w->ncols, 
+                               .nrows = w->nrows, .chunk_rows = w->chunk_rows, .nchunks = w->index.N / w->ncols };
+        memcpy(h.magic, COLFILE_MAGIC, 4);
+        ok = fseek(w->file, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, w->file) == 1;
+    }
+    if (w->file && fclose(w->file) != 0) ok = 0;
+    if (!ok && w->file) fprintf(stderr, "colfile_writer_close: write failed.\n");
+
+    colfile_writer_free_batch(w);
+    free(w->columns);
+    dynarray_free(&w->index);
+    memset(w, 0, sizeof(*w));
+    return ok;
+}
+
+
+
+
+static inline void colfile_close(s_colfile *f)
+{
+    if (!f) return;
+    if (f->map) munmap(f->map, f->map_size);
+    if (f->fd >= 0) close(f->fd);
+    free(f->columns);
+    free(f->index);
+    free(f->verified);
+    memset(f, 0, sizeof(*f));
+    f->fd = -1;
+}
+
+static inline int colfile_open(s_colfile *f, const char *path)
+{
+    memset(f, 0, sizeof(*f));
+    f->fd = open(path, O_RDONLY);
+    if (f->fd < 0) { fprintf(stderr, "colfile_open: could not open '%s'.\n", path); return 0; }
+
+    struct stat st;
+    if (fstat(f->fd, &st) != 0) goto error;
+    f->map_size = st.st_size;
+    if (f->map_size < sizeof(s_colfile_header) + sizeof(s_colfile_footer)) goto corrupt;
+    f->map = mmap(NULL, f->map_size, PROT_READ, MAP_PRIVATE, f->fd, 0);
+    if (f->map == MAP_FAILED) { f->map = NULL; goto error; }
+
+    /* Header */
+    memcpy(&f->header, f->map, sizeof(s_colfile_header));
+    if (memcmp(f->header.magic, COLFILE_MAGIC, 4) != 0) goto corrupt;
+    if (f->header.endian_tag != COLFILE_ENDIAN_TAG) {
+        colfile_bswap(&f->header.endian_tag, 4, 1);
+        if (f->header.endian_tag != COLFILE_ENDIAN_TAG) goto corrupt;
+        f->swap = true;
+        colfile_bswap(&f->header.version, 4, 1);
+        colfile_bswap(&f->header.ncols, 4, 1);
+        colfile_bswap(&f->header.nrows, 8, 1);
+        colfile_bswap(&f->header.chunk_rows, 4, 1);
+        colfile_bswap(&f->header.nchunks, 4, 1);
+    }
+    if (f->header.version < 1 || f->header.version > COLFILE_VERSION) { fprintf(stderr, "colfile_open: unsupported version %u.\n", f->header.version); goto error; }
+    uint32_t ncols = f->header.ncols, nchunks = f->header.nchunks;
+    if (ncols == 0 || f->header.chunk_rows == 0) goto corrupt;
+    if ((uint64_t)nchunks * f->header.chunk_rows < f->header.nrows) goto corrupt;
+
+    /* Column descriptors */
+    size_t cols_end = sizeof(s_colfile_header) + (size_t)ncols * sizeof(s_colfile_column);
+    if (cols_end > f->map_size) goto corrupt;
+    f->columns = malloc(ncols * sizeof(s_colfile_column));
+    if (!f->columns) goto error;
+    memcpy(f->columns, f->map + sizeof(s_colfile_header), ncols * sizeof(s_colfile_column));
+    for (uint32_t c = 0; c < ncols; c++) {
+        if (f->swap) { colfile_bswap(&f->columns[c].type, 4, 1); colfile_bswap(&f->columns[c].elem_size, 4, 1); }
+        f->columns[c].name[COLFILE_NAME_MAX - 1] = '\0';
+        if (f->columns[c].elem_size != colfile_type_size(f->columns[c].type)) goto corrupt;
+    }
+
+    /* Footer and index */
+    s_colfile_footer footer;
+    memcpy(&footer, f->map + f->map_size - sizeof(footer), sizeof(footer));
+    if (f->swap) { colfile_bswap(&footer.index_offset, 8, 1); colfile_bswap(&footer.index_crc, 4, 1); }
+    size_t nblocks = (size_t)nchunks * ncols;
+    size_t index_size = nblocks * sizeof(s_colfile_block);
+    if (memcmp(footer.magic, COLFILE_MAGIC, 4) != 0) goto corrupt;
+    if (footer.index_offset < cols_end || footer.index_offset + index_size + sizeof(footer) != f->map_size) goto corrupt;
+    if (files_crc32c(0, f->map + footer.index_offset, index_size) != footer.index_crc) goto corrupt;
+
+    f->index = malloc(index_size ? index_size : 1);
+    f->verified = calloc(nblocks ? nblocks : 1, 1);
+    if (!f->index || !f->verified) goto error;
+    memcpy(f->index, f->map + footer.index_offset, index_size);
+    for (size_t i = 0; i < nblocks; i++) {
+        s_colfile_block *b = &f->index[i];
+        if (f->swap) { colfile_bswap(&b->offset, 8, 1); colfile_bswap(&b->size, 8, 1); colfile_bswap(&b->crc, 4, 1); colfile_bswap(&b->filters, 4, 1); }
+        if (b->offset < cols_end || b->offset + b->size > footer.index_offset) goto corrupt;
+        if (b->filters & ~COLFILE_FILTER_FLOATS) goto corrupt;
+    }
+    return 1;
+
+corrupt:
+    fprintf(stderr, "colfile_open: '%s' is not a valid colfile.\n", path);
+error:
+    colfile_close(f);
+    return 0;
+}
+
+static inline int colfile_find_column(const s_colfile *f, const char *name)
+{
+    for (uint32_t c = 0; c < f->header.ncols; c++) 
+        if (strcmp(f->columns[c].name, name) == 0) return c;
+    return -1;
+}
+
+static inline uint32_t colfile_chunk_nrows(const s_colfile *f, uint32_t chunk)
+{
+    uint64_t begin = (uint64_t)chunk * f->header.chunk_rows;
+    uint64_t left = f->header.nrows - begin;
+    return left < f->header.chunk_rows ? (uint32_t)left : f->header.chunk_rows;
+}
+
+static inline const s_colfile_block *colfile_get_block(s_colfile *f, int col, uint32_t chunk)
+{   /* Returns the block after checking its CRC once. NULL if ERROR */
+    if (col < 0 || (uint32_t)col >= f->header.ncols || chunk >= f->header.nchunks) return NULL;
+    size_t id = (size_t)chunk * f->header.ncols + col;
+    const s_colfile_block *b = &f->index[id];
+    uint64_t raw_size = (uint64_t)colfile_chunk_nrows(f, chunk) * f->columns[col].elem_size;
+    if ((b->filters & COLFILE_FILTER_LZ) ? b->size > files_lz_bound(raw_size) : b->size != raw_size) return NULL;
+    if (!f->verified[id]) {
+        if (files_crc32c(0, f->map + b->offset, b->size) != b->crc) {
+            fprintf(stderr, "colfile: CRC mismatch in column '%s', chunk %u.\n", f->columns[col].name, chunk);
+            return NULL;
+        }
+        f->verified[id] = 1;
+    }
+    return b;
+}
+
+static inline const void *colfile_chunk_ptr(s_colfile *f, int col, uint32_t chunk, uint32_t *nrows)
+{
+    if (f->swap) return NULL;
+    const s_colfile_block *b = colfile_get_block(f, col, chunk);
+    if (!b || b->filters) return NULL;
+    if (nrows) *nrows = colfile_chunk_nrows(f, chunk);
+    return f->map + b->offset;
+}
+
+static inline int colfile_decode_block(const s_colfile *f, const s_colfile_block *b, size_t elem_size, size_t raw_size, void *dst, void *tmp)
+{   /* Decodes a checked block into native byte order. tmp needs raw_size bytes */
+    const uint8_t *src = f->map + b->offset;
+    const void *stage = src;
+    if (b->filters & COLFILE_FILTER_LZ) {
+        void *out = (b->filters & COLFILE_FILTER_SHUFFLE) ? tmp : dst;
+        if (!files_lz_decompress(src, b->size, out, raw_size)) return 0;
+        stage = out;
+    }
+    if (b->filters & COLFILE_FILTER_SHUFFLE) files_unshuffle(stage, dst, raw_size / elem_size, elem_size);
+    else if (stage != dst) memcpy(dst, stage, raw_size);
+
+    if (f->swap) colfile_bswap(dst, elem_size, raw_size / elem_size);
+    if (b->filters & COLFILE_FILTER_DELTA) files_delta_decode(dst, raw_size / elem_size, elem_size);
+    return 1;
+}
+
+static inline int colfile_read(s_colfile *f, int col, uint64_t row_begin, uint64_t row_end, void *out)
+{   /* Chunks are independent, so with OpenMP they are checked and decoded in parallel */
+    if (!f || col < 0 || (uint32_t)col >= f->header.ncols) return 0;
+    if (row_begin > row_end || row_end > f->header.nrows) return 0;
+    if (row_begin == row_end) return 1;
+    size_t es = f->columns[col].elem_size;
+    uint32_t chunk_rows = f->header.chunk_rows;
+    uint32_t chunk_begin = row_begin / chunk_rows;
+    uint32_t chunk_end = (row_end - 1) / chunk_rows + 1;
+    int ok = 1;
+
+#ifdef _OPENMP
+    #pragma omp parallel if (chunk_end - chunk_begin > 1)
+#endif
+    {
+        uint8_t *tmp = NULL, *whole = NULL;  /* Per thread, allocated on first filtered block */
+#ifdef _OPENMP
+        #pragma omp for schedule(dynamic)
+#endif
+        for (long k = chunk_begin; k < (long)chunk_end; k++) {
+            uint64_t first = (uint64_t)k * chunk_rows;
+            uint64_t last = first + colfile_chunk_nrows(f, k);
+            uint64_t lo = first > row_begin ? first : row_begin;
+            uint64_t hi = last < row_end ? last : row_end;
+            uint8_t *dst = (uint8_t*)out + (lo - row_begin) * es;
+            size_t raw_size = (last - first) * es;
+
+            const s_colfile_block *b = colfile_get_block(f, col, k);
+            int local_ok = b != NULL;
+            if (local_ok && !b->filters) {
+                memcpy(dst, f->map + b->offset + (lo - first) * es, (hi - lo) * es);
+                if (f->swap) colfile_bswap(dst, es, hi - lo);
+            } else if (local_ok) {
+                bool full = lo == first && hi == last;
+                if (!tmp) tmp = malloc((size_t)chunk_rows * es);
+                if (!full && !whole) whole = malloc((size_t)chunk_rows * es);
+                local_ok = tmp && (full || whole) && colfile_decode_block(f, b, es, raw_size, full ? dst : whole, tmp);
+                if (local_ok && !full) memcpy(dst, whole + (lo - first) * es, (hi - lo) * es);
+                if (!local_ok) fprintf(stderr, "colfile_read: could not decode column '%s', chunk %ld.\n", f->columns[col].name, k);
+            }
+            if (!local_ok) {
+#ifdef _OPENMP
+                #pragma omp atomic write
+#endif
+                ok = 0;
+            }
+        }
+        free(tmp);
+        free(whole);
+    }
+    return ok;
+}
+
+static inline int colfile_read_double(s_colfile *f, int col, uint64_t row_begin, uint64_t row_end, double *out)
+{   /* Reads in place: every stored type is at most as wide as a double, so convert backwards */
+    if (!colfile_read(f, col, row_begin, row_end, out)) return 0;
+    size_t n = row_end - row_begin;
+    switch ((e_colfile_type)f->columns[col].type) {
+        case COLFILE_INT32:  for (size_t i = n; i-- > 0;) out[i] = ((int32_t*)out)[i];  break;
+        case COLFILE_INT64:  for (size_t i = 0; i < n; i++) out[i] = ((int64_t*)out)[i];  break;
+        case COLFILE_UINT64: for (size_t i = 0; i < n; i++) out[i] = ((uint64_t*)out)[i]; break;
+        case COLFILE_FLOAT:  for (size_t i = n; i-- > 0;) out[i] = ((float*)out)[i];  break;
+        case COLFILE_DOUBLE: break;
+    }
+    return 1;
+}
+
+
+
+
+/* Text tables: one row per line, values separated by whitespace. Lines that are empty or 
+ * start with '#' are skipped. If names is NULL, they are taken from a first line of the form
+ * "# name1 name2 ..." (as written by colfile_to_text), or default to col0, col1, ...
+ * If ncols <= 0, it is inferred from the names or the first row. If types is NULL, all 
+ * columns are COLFILE_DOUBLE. */
+static inline int colfile_split_tokens(char *line, int max, char *tokens[max])
+{   /* Splits in place. Returns the number of tokens (may exceed max, extra are not stored) */
+    int n = 0;
+    for (char *tok = strtok(line, " \t\r\n,"); tok; tok = strtok(NULL, " \t\r\n,")) {
+        if (n < max) tokens[n] = tok;
+        n++;
+    }
+    return n;
+}
+
+static inline int colfile_from_text(const char *txt_path, const char *bin_path, int ncols, const char *const names[], const e_colfile_type types[], uint32_t chunk_rows)
+{
+    enum { MAX_COLS = 1024 };
+    FILE *in = fopen(txt_path, "r");
+    if (!in) { fprintf(stderr, "colfile_from_text: could not open '%s'.\n", txt_path); return 0; }
+
+    char *line = NULL, *header = NULL;
+    size_t line_cap = 0;
+    char *tokens[MAX_COLS];
+    const char *default_names[MAX_COLS];
+    char default_buf[MAX_COLS][16];
+    e_colfile_type default_types[MAX_COLS];
+    union { int32_t i32; int64_t i64; uint64_t u64; float f; double d; } values[MAX_COLS];
+    const void *ptrs[MAX_COLS];
+    s_colfile_writer w = {0};
+    bool writer_open = false;
+    int ok = 0;
+    uint64_t line_number = 0;
+
+    if (ncols > MAX_COLS) { fprintf(stderr, "colfile_from_text: too many columns.\n"); goto end; }
+
+    while (getline(&line, &line_cap, in) != -1) {
+        line_number++;
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#') {  /* Keep the first comment line as a possible header */
+            if (!header && !writer_open) header = strdup(p + 1);
+            continue;
+        }
+        if (*p == '\n' || *p == '\r' || *p == '\0') continue;
+
+        int n = colfile_split_tokens(p, MAX_COLS, tokens);
+        if (!writer_open) {  /* Resolve schema with the first data row */
+            int nheader = 0;
+            char *header_tokens[MAX_COLS];
+            if (!names && header) nheader = colfile_split_tokens(header, MAX_COLS, header_tokens);
+            if (nheader != n) nheader = 0;  /* Header does not describe the data */
+            if (ncols <= 0) ncols = n;
+            if (ncols > MAX_COLS) { fprintf(stderr, "colfile_from_text: too many columns.\n"); goto end; }
+            for (int c = 0; c < ncols; c++) {
+                snprintf(default_buf[c], sizeof(default_buf[c]), "col%d", c);
+                default_names[c] = nheader ? header_tokens[c] : default_buf[c];
+                default_types[c] = types ? types[c] : COLFILE_DOUBLE;
+                ptrs[c] = &values[c];
+            }
+            if (!colfile_writer_open(&w, bin_path, ncols, names ? names : default_names, default_types, chunk_rows)) goto end;
+            writer_open = true;
+        }
+        if (n != ncols) {
+            fprintf(stderr, "colfile_from_text: line %llu has %d values, expected %d.\n", (unsigned long long)line_number, n, ncols);
+            goto end;
+        }
+
+        for (int c = 0; c < ncols; c++) {
+            char *endptr;
+            switch (default_types[c]) {
+                case COLFILE_INT32:  values[c].i32 = strtol(tokens[c], &endptr, 10);    break;
+                case COLFILE_INT64:  values[c].i64 = strtoll(tokens[c], &endptr, 10);   break;
+                case COLFILE_UINT64: values[c].u64 = strtoull(tokens[c], &endptr, 10);  break;
+                case COLFILE_FLOAT:  values[c].f = strtof(tokens[c], &endptr);          break;
+                case COLFILE_DOUBLE: values[c].d = strtod(tokens[c], &endptr);          break;
+                default: endptr = tokens[c];
+            }
+            if (endptr == tokens[c] || *endptr != '\0') {
+                fprintf(stderr, "colfile_from_text: could not parse '%s' in line %llu.\n", tokens[c], (unsigned long long)line_number);
+                goto end;
+            }
+        }
+        if (!colfile_writer_append(&w, 1, ptrs)) goto end;
+    }
+    if (ferror(in)) goto end;
+    if (!writer_open) { fprintf(stderr, "colfile_from_text: '%s' has no data rows.\n", txt_path); goto end; }
+    ok = 1;
+
+end:
+    if (writer_open && !colfile_writer_close(&w)) ok = 0;
+    free(line);
+    free(header);
+    fclose(in);
+    return ok;
+}
+
+static inline int colfile_to_text(const char *bin_path, const char *txt_path)
+{
+    s_colfile f;
+    if (!colfile_open(&f, bin_path)) return 0;
+    FILE *out = fopen(txt_path, "w");
+    if (!out) { fprintf(stderr, "colfile_to_text: could not open '%s'.\n", txt_path); colfile_close(&f); return 0; }
+
+    uint32_t ncols = f.header.ncols, chunk_rows = f.header.chunk_rows;
+    const void **chunk = malloc(ncols * sizeof(void*));
+    uint8_t *scratch = malloc((size_t)ncols * chunk_rows * 8);  /* One decoded chunk */
+    int ok = chunk && scratch;
+
+    fprintf(out, "#");
+    for (uint32_t c = 0; c < ncols; c++) fprintf(out, " %s", f.columns[c].name);
+    fprintf(out, "\n");
+
+    for (uint32_t k = 0; ok && k < f.header.nchunks; k++) {
+        uint32_t n = colfile_chunk_nrows(&f, k);
+        uint64_t first = (uint64_t)k * chunk_rows;
+        for (uint32_t c = 0; ok && c < ncols; c++) {
+            chunk[c] = colfile_chunk_ptr(&f, c, k, NULL);  /* Zero-copy when possible */
+            if (!chunk[c]) {
+                void *dst = scratch + (size_t)c * chunk_rows * 8;
+                ok = colfile_read(&f, c, first, first + n, dst);
+                chunk[c] = dst;
+            }
+        }
+        for (uint32_t i = 0; ok && i < n; i++) {
+            for (uint32_t c = 0; c < ncols; c++) {
+                const char *sep = c + 1 < ncols ? " " : "\n";
+                switch ((e_colfile_type)f.columns[c].type) {
+                    case COLFILE_INT32:  fprintf(out, "%d%s", ((const int32_t*)chunk[c])[i], sep); break;
+                    case COLFILE_INT64:  fprintf(out, "%lld%s", (long long)((const int64_t*)chunk[c])[i], sep); break;
+                    case COLFILE_UINT64: fprintf(out, "%llu%s", (unsigned long long)((const uint64_t*)chunk[c])[i], sep); break;
+                    case COLFILE_FLOAT:  fprintf(out, "%.9g%s", ((const float*)chunk[c])[i], sep); break;
+                    case COLFILE_DOUBLE: fprintf(out, "%.17g%s", ((const double*)chunk[c])[i], sep); break;
+                }
+            }
+        }
+    }
+
+    if (fclose(out) != 0) ok = 0;
+    free(scratch);
+    free(chunk);
+    colfile_close(&f);
+    return ok;
+}
+
 #endif
 
 
@@ -0,0 +1,461 @@
+/* 
+ * Header-only asynchronous file I/O, companion of files.h.
+ * Asynchronous read-ahead and write-behind through a background I/O thread and a pool of
+ * buffers (link with -pthread), and a tail-follow reader for growing files, woken by inotify
+ * on Linux and polling elsewhere.
+ * 
+ * Copyright (c) 2026 Fernando Muñoz
+ * MIT license. See bottom of file.
+ */
+
+
+#ifndef HLIBS_FILES_ASYNC_H
+#define HLIBS_FILES_ASYNC_H
+#if !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200809L  /* pread, posix_fadvise, nanosleep with plain -std=c11 */
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+
+typedef struct async_file {  /* Ignore contents, implementation details */
+    int fd;
+    bool writing;
+    int nbuffers;
+    size_t buffer_size;
+    void *memory;          /* nbuffers * buffer_size bytes */
+    size_t *sizes;         /* Valid bytes in each buffer */
+    int *free_q, free_head, free_count;  /* FIFO of buffer ids owned by nobody */
+    int *full_q, full_head, full_count;  /* FIFO of buffer ids read (or to be written) */
+    pthread_mutex_t lock;
+    pthread_cond_t cond_free;
+    pthread_cond_t cond_full;
+    pthread_t thread;
+    uint64_t offset;       /* Next read offset, only used by the I/O thread */
+    bool done;             /* Reader: EOF or error reached. Writer: closing */
+    bool stop;             /* Reader: closing */
+    int error;             /* errno of the first failed read or write */
+} s_async_file;
+
+typedef struct file_follower {
+    char *path;
+    int fd;
+    dev_t dev;             /* Identity of the followed file, to detect rotation */
+    ino_t ino;
+    uint64_t offset;       /* Bytes consumed so far */
+    int64_t nlines;        /* '\n' seen so far */
+    bool partial;          /* Last byte consumed is not '\n' */
+    int resets;            /* Times the file was rotated or truncated */
+    bool drained;          /* Rotated and the old file was read to EOF: switch on the next read */
+    int inotify_fd;        /* -1 if not used (always, except on Linux) */
+    int watch;
+} s_file_follower;
+
+
+/* INTERFACE */
+/* All functions returning int, return 0 on ERROR, 1 on SUCCESS (unless stated otherwise). */
+static inline int async_reader_open(s_async_file *a, const char *path, int nbuffers, size_t buffer_size);  /* nbuffers >= 2 */
+static inline void *async_reader_next(s_async_file *a, size_t *size);  /* Next buffer in file order, NULL at EOF or ERROR (see a->error) */
+static inline void async_release(s_async_file *a, void *buf);  /* Gives a buffer from async_reader_next back */
+static inline int async_writer_open(s_async_file *a, const char *path, int nbuffers, size_t buffer_size);
+static inline void *async_writer_get(s_async_file *a);  /* Free buffer of buffer_size bytes, blocks until one is available */
+static inline int async_writer_submit(s_async_file *a, void *buf, size_t size);  /* Queues size bytes of buf. 0 if a previous write failed */
+static inline int async_close(s_async_file *a);  /* Writer: flushes queued buffers. 0 if any I/O failed */
+
+static inline int file_follow_open(s_file_follower *f, const char *path, bool use_inotify);  /* Starts at offset 0 */
+static inline void file_follow_close(s_file_follower *f);
+static inline int64_t file_follow_read(s_file_follower *f, void *buf, size_t cap);  /* New bytes read, 0 if none, -1 if ERROR */
+static inline int64_t file_follow_count_lines(s_file_follower *f);  /* Reads new bytes, returns lines as count_lines would. -1 if ERROR */
+static inline int file_follow_wait(s_file_follower *f, int timeout_ms);  /* 1 if the file changed, 0 on timeout, -1 if ERROR. timeout_ms < 0 waits forever */
+
+
+
+
+/* IMPLEMENTATION */
+/* Asynchronous I/O: a background thread reads ahead (or writes behind) through a pool of
+ * nbuffers buffers of buffer_size bytes, so I/O overlaps with the caller's compute. 
+ * Reader: async_reader_next hands out buffers in file order, give them back with 
+ * async_release. Writer: fill buffers from async_writer_get and queue them, in order, with 
+ * async_writer_submit. Several buffers can be held at once. Requires linking with -pthread. */
+static inline int async_pool_init(s_async_file *a, int fd, bool writing, int nbuffers, size_t buffer_size)
+{
+    memset(a, 0, sizeof(*a));
+    a->fd = fd;
+    a->writing = writing;
+    a->nbuffers = nbuffers;
+    a->buffer_size = buffer_size;
+    a->sizes = calloc(nbuffers, sizeof(size_t));
+    a->free_q = malloc(nbuffers * sizeof(int));
+    a->full_q = malloc(nbuffers * sizeof(int));
+    if (posix_memalign(&a->memory, 4096, (size_t)nbuffers * buffer_size) != 0) a->memory = NULL;
+    if (!a->sizes || !a->free_q || !a->full_q || !a->memory) return 0;
+
+    for (int i = 0; i < nbuffers; i++) a->free_q[i] = i;
+    a->free_count = nbuffers;
+    pthread_mutex_init(&a->lock, NULL);
+    pthread_cond_init(&a->cond_free, NULL);
+    pthread_cond_init(&a->cond_full, NULL);
+    return 1;
+}
+
+static inline void async_pool_free(s_async_file *a)
+{
+    if (a->fd >= 0) close(a->fd);
+    free(a->sizes);
+    free(a->free_q);
+    free(a->full_q);
+    free(a->memory);
+    memset(a, 0, sizeof(*a));
+    a->fd = -1;
+}
+
+static inline void async_queue_push(int *queue, int *head, int *count, int n, int id)
+{
+    queue[(*head + *count) % n] = id;
+    (*count)++;
+}
+
+static inline int async_queue_pop(int *queue, int *head, int *count, int n)
+{
+    int id = queue[*head];
+    *head = (*head + 1) % n;
+    (*count)--;
+    return id;
+}
+
+static inline void *async_reader_thread(void *arg)
+{
+    s_async_file *a = arg;
+    for (;;) {
+        pthread_mutex_lock(&a->lock);
+        while (a->free_count == 0 && !a->stop) pthread_cond_wait(&a->cond_free, &a->lock);
+        if (a->stop) { pthread_mutex_unlock(&a->lock); break; }
+        int id = async_queue_pop(a->free_q, &a->free_head, &a->free_count, a->nbuffers);
+        pthread_mutex_unlock(&a->lock);
+
+        uint8_t *buf = (uint8_t*)a->memory + (size_t)id * a->buffer_size;
+        size_t got = 0;
+        int err = 0;
+        while (got < a->buffer_size) {  /* Fill the whole buffer unless EOF */
+            ssize_t r = pread(a->fd, buf + got, a->buffer_size - got, a->offset + got);
+            if (r < 0 && errno == EINTR) continue;
+            if (r < 0) { err = errno; break; }
+            if (r == 0) break;
+            got += r;
+        }
+        a->offset += got;
+
+        pthread_mutex_lock(&a->lock);
+        a->sizes[id] = got;
+        if (got > 0) async_queue_push(a->full_q, &a->full_head, &a->full_count, a->nbuffers, id);
+        else async_queue_push(a->free_q, &a->free_head, &a->free_count, a->nbuffers, id);
+        bool last = err || got < a->buffer_size;
+        if (err) a->error = err;
+        if (last) a->done = true;
+        pthread_cond_signal(&a->cond_full);
+        pthread_mutex_unlock(&a->lock);
+        if (last) break;
+    }
+    return NULL;
+}
+
+static inline void *async_writer_thread(void *arg)
+{
+    s_async_file *a = arg;
+    for (;;) {
+        pthread_mutex_lock(&a->lock);
+        while (a->full_count == 0 && !a->done) pthread_cond_wait(&a->cond_full, &a->lock);
+        if (a->full_count == 0) { pthread_mutex_unlock(&a->lock); break; }  /* Done and drained */
+        int id = async_queue_pop(a->full_q, &a->full_head, &a->full_count, a->nbuffers);
+        bool failed = a->error != 0;
+        pthread_mutex_unlock(&a->lock);
+
+        const uint8_t *buf = (uint8_t*)a->memory + (size_t)id * a->buffer_size;
+        size_t put = 0;
+        int err = 0;
+        while (!failed && put < a->sizes[id]) {  /* After an error, buffers are only recycled */
+            ssize_t r = write(a->fd, buf + put, a->sizes[id] - put);
+            if (r < 0 && errno == EINTR) continue;
+            if (r < 0) { err = errno; break; }
+            put += r;
+        }
+
+        pthread_mutex_lock(&a->lock);
+        if (err) a->error = err;
+        async_queue_push(a->free_q, &a->free_head, &a->free_count, a->nbuffers, id);
+        pthread_cond_signal(&a->cond_free);
+        pthread_mutex_unlock(&a->lock);
+    }
+    return NULL;
+}
+
+static inline int async_open(s_async_file *a, const char *path, bool writing, int nbuffers, size_t buffer_size)
+{
+    if (nbuffers < 2 || buffer_size == 0) { fprintf(stderr, "async_open: need nbuffers >= 2 and buffer_size > 0.\n"); return 0; }
+    int fd = writing ? open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : open(path, O_RDONLY);
+    if (fd < 0) { fprintf(stderr, "async_open: could not open '%s'.\n", path); return 0; }
+    if (!async_pool_init(a, fd, writing, nbuffers, buffer_size)) { 
+        fprintf(stderr, "async_open: out of memory.\n"); 
+        async_pool_free(a); 
+        return 0; 
+    }
+    if (!writing) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    if (pthread_create(&a->thread, NULL, writing ? async_writer_thread : async_reader_thread, a) != 0) {
+        fprintf(stderr, "async_open: could not start I/O thread.\n");
+        async_pool_free(a);
+        return 0;
+    }
+    return 1;
+}
+
+static inline int async_reader_open(s_async_file *a, const char *path, int nbuffers, size_t buffer_size)
+{
+    return async_open(a, path, false, nbuffers, buffer_size);
+}
+
+static inline int async_writer_open(s_async_file *a, const char *path, int nbuffers, size_t buffer_size)
+{
+    return async_open(a, path, true, nbuffers, buffer_size);
+}
+
+static inline void *async_reader_next(s_async_file *a, size_t *size)
+{
+    pthread_mutex_lock(&a->lock);
+    while (a->full_count == 0 && !a->done) pthread_cond_wait(&a->cond_full, &a->lock);
+    void *buf = NULL;
+    if (a->full_count > 0) {
+        int id = async_queue_pop(a->full_q, &a->full_head, &a->full_count, a->nbuffers);
+        buf = (uint8_t*)a->memory + (size_t)id * a->buffer_size;
+        *size = a->sizes[id];
+    }
+    pthread_mutex_unlock(&a->lock);
+    return buf;
+}
+
+static inline void async_release(s_async_file *a, void *buf)
+{
+    int id = ((uint8_t*)buf - (uint8_t*)a->memory) / a->buffer_size;
+    pthread_mutex_lock(&a->lock);
+    async_queue_push(a->free_q, &a->free_head, &a->free_count, a->nbuffers, id);
+    pthread_cond_signal(&a->cond_free);
+    pthread_mutex_unlock(&a->lock);
+}
+
+static inline void *async_writer_get(s_async_file *a)
+{
+    pthread_mutex_lock(&a->lock);
+    while (a->free_count == 0) pthread_cond_wait(&a->cond_free, &a->lock);
+    int id = async_queue_pop(a->free_q, &a->free_head, &a->free_count, a->nbuffers);
+    pthread_mutex_unlock(&a->lock);
+    return (uint8_t*)a->memory + (size_t)id * a->buffer_size;
+}
+
+static inline int async_writer_submit(s_async_file *a, void *buf, size_t size)
+{
+    int id = ((uint8_t*)buf - (uint8_t*)a->memory) / a->buffer_size;
+    if (size > a->buffer_size) size = a->buffer_size;
+    pthread_mutex_lock(&a->lock);
+    a->sizes[id] = size;
+    async_queue_push(a->full_q, &a->full_head, &a->full_count, a->nbuffers, id);
+    int ok = a->error == 0;
+    pthread_cond_signal(&a->cond_full);
+    pthread_mutex_unlock(&a->lock);
+    return ok;
+}
+
+static inline int async_close(s_async_file *a)
+{
+    pthread_mutex_lock(&a->lock);
+    if (a->writing) a->done = true;  /* Writer drains the queue before exiting */
+    else a->stop = true;
+    pthread_cond_broadcast(&a->cond_free);
+    pthread_cond_broadcast(&a->cond_full);
+    pthread_mutex_unlock(&a->lock);
+    pthread_join(a->thread, NULL);
+
+    int ok = a->error == 0;
+    if (!ok) fprintf(stderr, "async_close: I/O error: %s.\n", strerror(a->error));
+    if (a->writing && close(a->fd) != 0) ok = 0;
+    if (a->writing) a->fd = -1;
+    pthread_mutex_destroy(&a->lock);
+    pthread_cond_destroy(&a->cond_free);
+    pthread_cond_destroy(&a->cond_full);
+    async_pool_free(a);
+    return ok;
+}
+
+
+
+
+/* Tail-follow reader for files that are still being written. Remembers the offset and line 
+ * count, so each call only reads newly appended bytes. If the path now refers to another file
+ * (rotation), the old file, still open, is first read to its end, as tail -F does; the next
+ * read starts at the beginning of the new file and increments resets. If the file shrank
+ * (truncation), it starts again from its beginning and increments resets. */
+static inline int file_follow_attach(s_file_follower *f)
+{   /* (Re)opens path and (re)installs the inotify watch */
+    if (f->fd >= 0) close(f->fd);
+    f->fd = open(f->path, O_RDONLY);
+    if (f->fd < 0) return 0;
+    struct stat st;
+    if (fstat(f->fd, &st) != 0) return 0;
+    f->dev = st.st_dev;
+    f->ino = st.st_ino;
+#ifdef __linux__
+    if (f->inotify_fd >= 0) {
+        if (f->watch >= 0) inotify_rm_watch(f->inotify_fd, f->watch);
+        f->watch = inotify_add_watch(f->inotify_fd, f->path, IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+    }
+#endif
+    return 1;
+}
+
+static inline int file_follow_open(s_file_follower *f, const char *path, bool use_inotify)
+{
+    memset(f, 0, sizeof(*f));
+    f->fd = f->inotify_fd = f->watch = -1;
+    f->path = strdup(path);
+    if (!f->path) return 0;
+#ifdef __linux__
+    if (use_inotify) f->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);  /* Falls back to polling if it fails */
+#else
+    (void)use_inotify;
+#endif
+    if (!file_follow_attach(f)) {
+        fprintf(stderr, "file_follow_open: could not open '%s'.\n", path);
+        file_follow_close(f);
+        return 0;
+    }
+    return 1;
+}
+
+static inline void file_follow_close(s_file_follower *f)
+{
+    if (!f) return;
+    if (f->fd >= 0) close(f->fd);
+    if (f->inotify_fd >= 0) close(f->inotify_fd);
+    free(f->path);
+    memset(f, 0, sizeof(*f));
+    f->fd = f->inotify_fd = f->watch = -1;
+}
+
+static inline void file_follow_reset(s_file_follower *f)
+{
+    f->offset = 0;
+    f->nlines = 0;
+    f->partial = false;
+    f->resets++;
+}
+
+static inline int file_follow_check(s_file_follower *f, bool *rotated)
+{   /* Detects rotation (the old file is kept open) and truncation. 0 if ERROR */
+    struct stat st;
+    *rotated = stat(f->path, &st) == 0 && (st.st_ino != f->ino || st.st_dev != f->dev);
+    if (fstat(f->fd, &st) != 0) return 0;
+    if ((uint64_t)st.st_size < f->offset) file_follow_reset(f);
+    return 1;
+}
+
+static inline int64_t file_follow_read(s_file_follower *f, void *buf, size_t cap)
+{
+    if (!f) return 0;
+    if (f->fd < 0 || f->drained) {  /* Rotated, or the path was missing after a rotation */
+        f->drained = false;
+        if (!file_follow_attach(f)) return 0;
+        file_follow_reset(f);
+    }
+    bool rotated;
+    if (!file_follow_check(f, &rotated)) return -1;
+
+    ssize_t n;
+    do { n = pread(f->fd, buf, cap, f->offset); } while (n < 0 && errno == EINTR);
+    if (n < 0) return -1;
+    if (n == 0 && rotated) f->drained = true;  /* Nothing left in the old file */
+
+    const char *p = buf;
+    for (ssize_t i = 0; i < n; i++) f->nlines += p[i] == '\n';
+    if (n > 0) f->partial = p[n - 1] != '\n';
+    f->offset += n;
+    return n;
+}
+
+static inline int64_t file_follow_count_lines(s_file_follower *f)
+{   /* After a rotation, returns the final count of the old file if its tail was still unread,
+     * otherwise goes on with the new file */
+    char buf[1 << 16];
+    int64_t n, total = 0;
+    do {
+        while ((n = file_follow_read(f, buf, sizeof(buf))) > 0) total += n;
+        if (n < 0) return -1;
+    } while (f->drained && total == 0);
+    return f->nlines + f->partial;
+}
+
+static inline int file_follow_wait(s_file_follower *f, int timeout_ms)
+{
+    const int POLL_MS = 50;  /* Without inotify */
+    for (int waited = 0; ; ) {
+        struct stat st;
+        if (stat(f->path, &st) == 0 && (st.st_ino != f->ino || st.st_dev != f->dev || (uint64_t)st.st_size != f->offset)) return 1;
+        if (timeout_ms >= 0 && waited >= timeout_ms) return 0;
+
+        int step = timeout_ms < 0 ? POLL_MS : (timeout_ms - waited < POLL_MS ? timeout_ms - waited : POLL_MS);
+#ifdef __linux__
+        if (f->inotify_fd >= 0 && f->watch >= 0) {
+            struct pollfd pfd = { .fd = f->inotify_fd, .events = POLLIN };
+            int r = poll(&pfd, 1, timeout_ms < 0 ? -1 : timeout_ms - waited);
+            if (r < 0 && errno != EINTR) return -1;
+            char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            while (read(f->inotify_fd, events, sizeof(events)) > 0);  /* Drain, then look at the file again */
+            if (r == 0) waited = timeout_ms;
+            else if (r > 0) return 1;
+            continue;
+        }
+#endif
+        struct timespec ts = { .tv_sec = step / 1000, .tv_nsec = (step % 1000) * 1000000L };
+        nanosleep(&ts, NULL);
+        waited += step;
+    }
+}
+
+#endif
+
+
+/* MIT License.
+ *
+ * Copyright (c) 2026 Fernando Muñoz.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
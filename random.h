@@ -36,6 +36,7 @@ static inline uint64_t random_uniform_range_u64(s_random_context *ctx, uint64_t
 static inline double random_uniform_double(s_random_context *ctx);  /* [0,1) */
 static inline double random_normal(s_random_context *ctx, double mean, double std);
 static inline int random_poisson(s_random_context *ctx, double lambda);
+static inline int64_t random_binomial(s_random_context *ctx, int64_t n, double p);
 static inline void random_shuffle(s_random_context *ctx, int N, int out[N]);
 static inline void random_pdf_to_cdf(int N, const double pdf[N], double cdf[N]);  /* Can be used in-place */
 static inline int random_sample_cdf(s_random_context *ctx, int N, const double cdf[N]);  /* No need to be normalised */
@@ -255,6 +256,57 @@ static inline int random_poisson(s_random_context *ctx, double lambda)
 }
 
 
+static inline int64_t random_binomial_INVERSION(s_random_context *ctx, int64_t n, double p)
+{   /* Sequential search on the cdf, expected n*p + 1 iterations */
+    double q = 1.0 - p;
+    double s = p / q;
+    double a = (n + 1) * s;
+    double r = exp(n * log1p(-p));
+    double u = random_uniform_double(ctx);
+    int64_t x = 0;
+    while (u > r && x < n) {
+        u -= r;
+        x++;
+        r *= a / x - s;
+    }
+    return x;
+}
+
+static inline int64_t random_binomial_BTRS(s_random_context *ctx, int64_t n, double p)
+{   /* Transformed rejection with squeeze by Hormann (1993), for n*p >= 10 */
+    double q = 1.0 - p;
+    double spq = sqrt(n * p * q);
+    double b = 1.15 + 2.53 * spq;
+    double a = -0.0873 + 0.0248 * b + 0.01 * p;
+    double c = n * p + 0.5;
+    double vr = 0.92 - 4.2 / b;
+    double alpha = (2.83 + 5.1 / b) * spq;
+    double lpq = log(p / q);
+    double m = floor((n + 1) * p);
+    double h = lgamma(m + 1) + lgamma(n - m + 1);
+    for (;;) {
+        double u = random_uniform_double(ctx) - 0.5;
+        double v = random_uniform_double(ctx);
+        double us = 0.5 - fabs(u);
+        double k = floor((2 * a / us + b) * u + c);
+        if (k < 0 || k > n) continue;
+        if (us >= 0.07 && v <= vr) return (int64_t)k;
+        v = log(v * alpha / (a / (us * us) + b));
+        if (v <= h - lgamma(k + 1) - lgamma(n - k + 1) + (k - m) * lpq) return (int64_t)k;
+    }
+}
+
+static inline int64_t random_binomial(s_random_context *ctx, int64_t n, double p)
+{   /* Number of successes in n trials of probability p */
+    if (n <= 0 || !(p > 0.0)) return 0;
+    if (p >= 1.0) return n;
+    if (p > 0.5) return n - random_binomial(ctx, n, 1.0 - p);
+
+    if (n * p < 10.0) return random_binomial_INVERSION(ctx, n, p);
+    else return random_binomial_BTRS(ctx, n, p);
+}
+
+
 static inline void random_shuffle(s_random_context *ctx, int N, int out[N])
 {  /* Fisher-Yates algorithm */
     for (int i=0; i<N; i++) out[i] = i;  /* Initialize */
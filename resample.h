@@ -0,0 +1,282 @@
+/*
+ * Header-only bootstrap and jackknife resampling.
+ * The statistic is given as an accumulator (init, add, merge, finalize callbacks), so
+ * resamples are represented by integer weights on the items instead of index arrays:
+ * Poisson(1) weights (independent per item, replica size n on average) or multinomial 
+ * weights (replica size exactly n, as in the classic bootstrap: the n draws are split among
+ * blocks with binomials, then land uniformly in each block). Data is processed in blocks of
+ * RESAMPLE_BLOCK items and, within a block, for every replica, so each block stays in cache.
+ * Blocks are split into one contiguous range per context (see random_initialize_threads),
+ * and contexts are spread over OpenMP threads. Results are reproducible for a fixed number of
+ * contexts, whatever the number of threads (or none).
+ * The delete-d jackknife reuses per-group accumulators with prefix and suffix merges, so it
+ * costs O(n) adds and O(n/d) merges.
+ *
+ * Copyright (c) 2026 Fernando Muñoz
+ * MIT license. See bottom of file.
+ */
+
+#ifndef HLIBS_RESAMPLE_H
+#define HLIBS_RESAMPLE_H
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "random.h"
+#include "stats.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+/* To be defined by the user: */
+typedef void   (*f_resample_init)(void *acc, void *user);  /* Empty accumulator */
+typedef void   (*f_resample_add)(void *acc, size_t i, int64_t weight, void *user);  /* Add item i, weight times */
+typedef void   (*f_resample_merge)(void *acc, const void *other, void *user);  /* acc absorbs other */
+typedef double (*f_resample_finalize)(const void *acc, void *user);  /* Value of the statistic */
+
+typedef struct resample_stat {
+    size_t acc_size;  /* Bytes of one accumulator, which must be plain data (copied with memcpy) */
+    f_resample_init init;
+    f_resample_add add;
+    f_resample_merge merge;
+    f_resample_finalize finalize;
+    void *user;       /* Passed to the callbacks, e.g. the data */
+} s_resample_stat;
+
+typedef enum {
+    RESAMPLE_POISSON,
+    RESAMPLE_MULTINOMIAL,
+} e_resample_weights;
+
+#define RESAMPLE_BLOCK 4096  /* Items per block */
+
+
+
+/* INTERFACE */
+/* Fills out[nreplicas] with the statistic of each replica. ctx[nctx] are per-thread contexts,
+ * also the maximum number of threads used. 0 ERROR, 1 OK */
+static inline int resample_bootstrap(const s_resample_stat *stat, size_t n, int nreplicas, e_resample_weights weights, int nctx, s_random_context ctx[nctx], double out[nreplicas]);
+/* Delete-d jackknife over n/d contiguous groups. out[n/d] (optional) gets the leave-one-group-out
+ * values; estimate is bias corrected. 0 ERROR, 1 OK */
+static inline int resample_jackknife(const s_resample_stat *stat, size_t n, size_t d, double *out, double *estimate, double *error);
+static inline double resample_standard_error(int nreplicas, const double replicas[nreplicas]);
+/* Percentile interval containing a fraction level (e.g. 0.95) of the replicas. 0 ERROR, 1 OK */
+static inline int resample_percentile_interval(int nreplicas, const double replicas[nreplicas], double level, double *lo, double *hi);
+
+
+
+/* IMPLEMENTATION */
+static inline int64_t resample_poisson1(s_random_context *ctx)
+{   /* Poisson(1) by inversion of its cdf with a single uniform */
+    static const double cdf[] = { 0.36787944117144233, 0.73575888234288467, 0.91969860292860584,
+                                  0.98101184312384626, 0.99634015317265634, 0.99940581518241833,
+                                  0.99991675885071196, 0.99998975080332531, 0.99999887479740202,
+                                  0.9999998885745216, 0.9999999899522336, 0.99999999916838922,
+                                  0.99999999993640221 };
+    double u = random_uniform_double(ctx);
+    int64_t k = 0;
+    while (k < (int64_t)(sizeof(cdf) / sizeof(cdf[0])) && u >= cdf[k]) k++;
+    return k;
+}
+
+static inline int resample_bootstrap(const s_resample_stat *stat, size_t n, int nreplicas, e_resample_weights weights, int nctx, s_random_context ctx[nctx], double out[nreplicas])
+{
+    if (n == 0 || nreplicas <= 0 || nctx <= 0) return 0;
+    size_t nblocks = (n + RESAMPLE_BLOCK - 1) / RESAMPLE_BLOCK;
+    char *accs = malloc((size_t)nctx * nreplicas * stat->acc_size);
+    int64_t *counts = NULL;  /* [nreplicas][nblocks], multinomial draws per block */
+    if (weights == RESAMPLE_MULTINOMIAL) counts = malloc((size_t)nreplicas * nblocks * sizeof(int64_t));
+    if (!accs || (weights == RESAMPLE_MULTINOMIAL && !counts)) {
+        fprintf(stderr, "resample_bootstrap: out of memory.\n");
+        free(accs); free(counts);
+        return 0;
+    }
+
+    if (weights == RESAMPLE_MULTINOMIAL) {
+        /* Split the n draws of each replica among blocks with conditional binomials */
+        for (int r = 0; r < nreplicas; r++) {
+            int64_t left = n;
+            size_t items_left = n;
+            for (size_t b = 0; b < nblocks; b++) {
+                size_t size = b + 1 < nblocks ? RESAMPLE_BLOCK : n - b * RESAMPLE_BLOCK;
+                int64_t k = random_binomial(&ctx[0], left, (double)size / items_left);
+                counts[(size_t)r * nblocks + b] = k;
+                left -= k;
+                items_left -= size;
+            }
+        }
+    }
+
+    /* Context t owns a fixed range of blocks and its own accumulators, so the result depends
+     * on nctx only, not on how many threads OpenMP actually gives */
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(nctx)
+#endif
+    for (int t = 0; t < nctx; t++) {
+        int64_t hist[RESAMPLE_BLOCK];
+        char *acc = accs + (size_t)t * nreplicas * stat->acc_size;
+        for (int r = 0; r < nreplicas; r++) stat->init(acc + r * stat->acc_size, stat->user);
+
+        size_t first = nblocks * t / nctx, last = nblocks * (t + 1) / nctx;
+        for (size_t b = first; b < last; b++) {
+            size_t begin = b * RESAMPLE_BLOCK;
+            size_t end = begin + RESAMPLE_BLOCK < n ? begin + RESAMPLE_BLOCK : n;
+            for (int r = 0; r < nreplicas; r++) {
+                void *a = acc + r * stat->acc_size;
+                if (weights == RESAMPLE_POISSON) {
+                    for (size_t i = begin; i < end; i++) {
+                        int64_t w = resample_poisson1(&ctx[t]);
+                        if (w) stat->add(a, i, w, stat->user);
+                    }
+                } else {
+                    /* The block's draws land uniformly on its items */
+                    memset(hist, 0, (end - begin) * sizeof(int64_t));
+                    for (int64_t k = counts[(size_t)r * nblocks + b]; k > 0; k--) 
+                        hist[random_uniform_range_u64(&ctx[t], end - begin)]++;
+                    for (size_t i = begin; i < end; i++) 
+                        if (hist[i - begin]) stat->add(a, i, hist[i - begin], stat->user);
+                }
+            }
+        }
+    }
+
+    /* Merge contexts in a fixed order */
+    for (int t = 1; t < nctx; t++) {
+        for (int r = 0; r < nreplicas; r++)
+            stat->merge(accs + r * stat->acc_size, accs + ((size_t)t * nreplicas + r) * stat->acc_size, stat->user);
+    }
+    for (int r = 0; r < nreplicas; r++) out[r] = stat->finalize(accs + r * stat->acc_size, stat->user);
+
+    free(accs);
+    free(counts);
+    return 1;
+}
+
+
+static inline int resample_jackknife(const s_resample_stat *stat, size_t n, size_t d, double *out, double *estimate, double *error)
+{
+    if (d == 0 || n / d < 2) {
+        fprintf(stderr, "resample_jackknife: need at least two groups.\n");
+        return 0;
+    }
+    size_t g = n / d;
+    size_t A = stat->acc_size;
+    char *groups = malloc(g * A);
+    char *prefix = malloc((g + 1) * A);  /* prefix[j]: groups [0, j) */
+    char *suffix = malloc((g + 1) * A);  /* suffix[j]: groups [j, g) */
+    char *loo = malloc(A);
+    double *values = out ? out : malloc(g * sizeof(double));
+    if (!groups || !prefix || !suffix || !loo || !values) {
+        fprintf(stderr, "resample_jackknife: out of memory.\n");
+        free(groups); free(prefix); free(suffix); free(loo);
+        if (!out) free(values);
+        return 0;
+    }
+
+    /* Groups are contiguous, the first n % g ones have one extra item */
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (long j = 0; j < (long)g; j++) {
+        size_t begin = j * (n / g) + ((size_t)j < n % g ? (size_t)j : n % g);
+        size_t end = begin + n / g + ((size_t)j < n % g);
+        void *a = groups + j * A;
+        stat->init(a, stat->user);
+        for (size_t i = begin; i < end; i++) stat->add(a, i, 1, stat->user);
+    }
+
+    stat->init(prefix, stat->user);
+    for (size_t j = 0; j < g; j++) {
+        memcpy(prefix + (j + 1) * A, prefix + j * A, A);
+        stat->merge(prefix + (j + 1) * A, groups + j * A, stat->user);
+    }
+    stat->init(suffix + g * A, stat->user);
+    for (size_t j = g; j-- > 0; ) {
+        memcpy(suffix + j * A, suffix + (j + 1) * A, A);
+        stat->merge(suffix + j * A, groups + j * A, stat->user);
+    }
+
+    s_sample s = stats_init_sample();
+    for (size_t j = 0; j < g; j++) {
+        memcpy(loo, prefix + j * A, A);
+        stat->merge(loo, suffix + (j + 1) * A, stat->user);
+        values[j] = stat->finalize(loo, stat->user);
+        s = stats_add_sample(s, values[j]);
+    }
+    double full = stat->finalize(prefix + g * A, stat->user);
+    if (estimate) *estimate = g * full - (g - 1) * stats_mean(s);
+    if (error) *error = sqrt((double)(g - 1) / g * s.M2);
+
+    free(groups); free(prefix); free(suffix); free(loo);
+    if (!out) free(values);
+    return 1;
+}
+
+
+static inline double resample_standard_error(int nreplicas, const double replicas[nreplicas])
+{
+    s_sample s = stats_add_array(stats_init_sample(), replicas, nreplicas);
+    return stats_standard_deviation(s, STATS_SAMPLE);
+}
+
+static inline int resample_cmp_double(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static inline int resample_percentile_interval(int nreplicas, const double replicas[nreplicas], double level, double *lo, double *hi)
+{
+    if (nreplicas <= 0 || !(level > 0 && level < 1)) return 0;
+    double *sorted = malloc(nreplicas * sizeof(double));
+    if (!sorted) {
+        fprintf(stderr, "resample_percentile_interval: out of memory.\n");
+        return 0;
+    }
+    memcpy(sorted, replicas, nreplicas * sizeof(double));
+    qsort(sorted, nreplicas, sizeof(double), resample_cmp_double);
+
+    /* Linear interpolation between order statistics */
+    double qs[2] = { (1 - level) / 2, (1 + level) / 2 };
+    double res[2];
+    for (int k = 0; k < 2; k++) {
+        double pos = qs[k] * (nreplicas - 1);
+        int i = (int)pos;
+        double f = pos - i;
+        res[k] = i + 1 < nreplicas ? sorted[i] * (1 - f) + sorted[i + 1] * f : sorted[i];
+    }
+    *lo = res[0];
+    *hi = res[1];
+    free(sorted);
+    return 1;
+}
+
+
+
+#endif
+
+
+/* MIT License.
+ *
+ * Copyright (c) 2026 Fernando Muñoz.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
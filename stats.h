@@ -1,7 +1,22 @@
 /* 
  * Header-only simple statistics library
  * Computes first and second moments of a sample robustly in an incremental manner,
- * internally using welford's online algorithm. Can be extended for 3rd and 4rth moments.
+ * internally using welford's online algorithm. s_moments extends this to 3rd and 4th 
+ * moments (skewness, kurtosis) and to weighted samples.
+ * s_multisample keeps the mean vector and covariance matrix of d-dimensional observations.
+ * s_blocking estimates the error of the mean of correlated series online (blocking).
+ * s_window and s_ewma give statistics over recent data: sliding windows (by count or time)
+ * and exponentially weighted averages with a half-life.
+ * s_hll counts distinct keys and s_count_sketch estimates key frequencies (heavy hitters)
+ * in fixed memory.
+ * s_tdigest estimates quantiles (median, p99, ...) of a stream in bounded memory.
+ * s_hdr_histogram records integer latencies with fixed relative precision at the cost of an
+ * increment, for instrumenting hot paths.
+ * Arrays can be accumulated in blocks at close to memory bandwidth (stats_add_array).
+ * With OpenMP, s_sample can be used in reductions: 
+ *     #pragma omp parallel for reduction(stats_merge : sample)
+ * whose merge order depends on the runtime. stats_merge_tree and stats_add_array_parallel
+ * merge in a fixed order, so results do not depend on the number of threads.
  * 
  * Copyright (c) 2026 Fernando Muñoz
  * MIT license. See bottom of file.
@@ -9,13 +24,29 @@
 
 #ifndef HLIBS_STATS_H
 #define HLIBS_STATS_H
+#if !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200809L  /* clock_gettime, CLOCK_MONOTONIC with plain -std=c11 */
+#endif
+
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define STATS_PI  3.14159265358979323846  /* M_PI and M_LN2 are not ISO C */
+#define STATS_LN2 0.69314718055994530942
 
 typedef struct sample {  
-    int N;
+    int64_t N;
     double mu;           /* Running mean */
     double M2;           /* Sum of squared deviations */
 } s_sample;
@@ -35,7 +66,7 @@ static inline s_sample stats_init_sample()
 static inline s_sample stats_add_sample(s_sample sample, double x)
 {
     double d = x - sample.mu;
-    int N = sample.N + 1;
+    int64_t N = sample.N + 1;
     double mu = sample.mu + d/N;
     double M2 = sample.M2 + (x - mu) * d;
     return (s_sample){ .N = N, .mu = mu, .M2 = M2 };
@@ -48,13 +79,101 @@ static inline s_sample stats_merge_samples(s_sample A, s_sample B)
     if (B.N == 0) return A;
 
     double d = B.mu - A.mu;
-    int N_AB = A.N + B.N;
+    int64_t N_AB = A.N + B.N;
     double mu_AB = (A.N*A.mu + B.N*B.mu) / N_AB;
     double M2_AB = A.M2 + B.M2 + d*d*A.N*B.N/N_AB;
     return (s_sample){ .N = N_AB, .mu = mu_AB, .M2 = M2_AB };
 }
 
 
+/* Batch updates: the array is split in blocks that fit in L1. Each block is summarised with 
+ * a two-pass mean and M2, using STATS_LANES independent accumulators so the loops vectorise 
+ * (no divide, no loop-carried dependency). Block summaries are merged pairwise, like a binary
+ * counter, so rounding errors grow as O(log n) instead of O(n). */
+#define STATS_BLOCK 1024  /* Elements per block */
+#define STATS_LANES 8
+
+static inline s_sample stats_block_sample(const double *x, int n)
+{   /* n in [1, STATS_BLOCK] */
+    double acc[STATS_LANES] = {0};
+    int i = 0;
+    for (; i + STATS_LANES <= n; i += STATS_LANES)
+        for (int l = 0; l < STATS_LANES; l++) acc[l] += x[i + l];
+    double sum = 0;
+    for (int l = 0; l < STATS_LANES; l++) sum += acc[l];
+    for (; i < n; i++) sum += x[i];
+    double mu = sum / n;
+
+    double acc2[STATS_LANES] = {0}, accd[STATS_LANES] = {0};
+    for (i = 0; i + STATS_LANES <= n; i += STATS_LANES) {
+        for (int l = 0; l < STATS_LANES; l++) {
+            double d = x[i + l] - mu;
+            accd[l] += d;
+            acc2[l] += d * d;
+        }
+    }
+    double sum2 = 0, sumd = 0;
+    for (int l = 0; l < STATS_LANES; l++) { sum2 += acc2[l]; sumd += accd[l]; }
+    for (; i < n; i++) { double d = x[i] - mu; sumd += d; sum2 += d * d; }
+
+    /* Corrected two-pass: removes the error left in mu */
+    return (s_sample){ .N = n, .mu = mu + sumd / n, .M2 = sum2 - sumd * sumd / n };
+}
+
+static inline s_sample stats_add_array(s_sample sample, const double *x, size_t n)
+{
+    s_sample levels[64];  /* levels[k]: merge of 2^k blocks, or empty */
+    int nlevels = 0;
+    for (size_t i = 0; i < n; i += STATS_BLOCK) {
+        int m = n - i < STATS_BLOCK ? (int)(n - i) : STATS_BLOCK;
+        s_sample carry = stats_block_sample(x + i, m);
+        int k = 0;
+        for (; k < nlevels && levels[k].N > 0; k++) {
+            carry = stats_merge_samples(levels[k], carry);
+            levels[k] = (s_sample){0};
+        }
+        if (k == nlevels) nlevels++;
+        levels[k] = carry;
+    }
+    for (int k = 0; k < nlevels; k++) sample = stats_merge_samples(sample, levels[k]);
+    return sample;
+}
+
+
+#ifdef _OPENMP
+#pragma omp declare reduction(stats_merge : s_sample : omp_out = stats_merge_samples(omp_out, omp_in)) initializer(omp_priv = stats_init_sample())
+#endif
+
+static inline s_sample stats_merge_tree(size_t n, const s_sample parts[])
+{   /* Merges parts[0..n) pairwise in a fixed tree: (0 1)(2 3), ... */
+    if (n == 0) return stats_init_sample();
+    if (n == 1) return parts[0];
+    size_t half = n / 2;
+    return stats_merge_samples(stats_merge_tree(half, parts), stats_merge_tree(n - half, parts + half));
+}
+
+#define STATS_PARALLEL_BLOCK (64 * STATS_BLOCK)  /* Elements per task, fixed so results do not depend on threads */
+
+static inline s_sample stats_add_array_parallel(s_sample sample, const double *x, size_t n)
+{   /* Blocks are summarised in parallel (OpenMP) and merged with stats_merge_tree */
+    size_t nblocks = (n + STATS_PARALLEL_BLOCK - 1) / STATS_PARALLEL_BLOCK;
+    s_sample *parts = malloc(nblocks * sizeof(s_sample));
+    if (!parts) return stats_add_array(sample, x, n);  /* Same statistics, different rounding */
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (long b = 0; b < (long)nblocks; b++) {
+        size_t begin = (size_t)b * STATS_PARALLEL_BLOCK;
+        size_t m = n - begin < STATS_PARALLEL_BLOCK ? n - begin : STATS_PARALLEL_BLOCK;
+        parts[b] = stats_add_array(stats_init_sample(), x + begin, m);
+    }
+    s_sample out = stats_merge_samples(sample, stats_merge_tree(nblocks, parts));
+    free(parts);
+    return out;
+}
+
+
 static inline double stats_mean(s_sample sample)
 {
     return sample.mu;
@@ -77,6 +196,1758 @@ static inline double stats_standard_deviation(s_sample sample, e_stats_type type
 }
 
 
+
+
+
+/* Higher-order moments (skewness, kurtosis) and weighted samples.
+ * s_moments keeps the sum of weights W and the weighted sums of powers of deviations from 
+ * the mean, updated with the single-pass formulas of Terriberry and the pairwise merges of 
+ * Pébay (2008). Unweighted values have weight 1, so W = N. Weights are either frequency 
+ * weights (repeat counts) or reliability weights (e.g. 1/variance): this only changes the 
+ * unbiased (STATS_SAMPLE) variance. */
+typedef struct moments {
+    int64_t N;           /* Number of values */
+    double W;            /* Sum of weights */
+    double W2;           /* Sum of squared weights */
+    double mu;           /* Weighted mean */
+    double M2, M3, M4;   /* Weighted sums of 2nd, 3rd and 4th powers of deviations */
+} s_moments;
+
+typedef enum {
+    STATS_FREQUENCY_WEIGHTS,
+    STATS_RELIABILITY_WEIGHTS,
+} e_stats_weights;
+
+
+static inline s_moments stats_init_moments()
+{
+    return (s_moments){0};
+}
+
+static inline s_moments stats_add_weighted_moment(s_moments m, double x, double w)
+{   /* Merge of m with a single value of weight w */
+    if (w == 0) { m.N++; return m; }
+    double Wa = m.W, W = m.W + w;
+    double d = x - m.mu, dW = d / W;
+    double t = d * dW * Wa * w;  /* Increment of M2 */
+    s_moments out = { .N = m.N + 1, .W = W, .W2 = m.W2 + w*w, .mu = m.mu + w*dW };
+    out.M4 = m.M4 + t*dW*dW*(Wa*Wa - Wa*w + w*w) + 6*dW*dW*w*w*m.M2 - 4*dW*w*m.M3;
+    out.M3 = m.M3 + t*dW*(Wa - w) - 3*dW*w*m.M2;
+    out.M2 = m.M2 + t;
+    return out;
+}
+
+static inline s_moments stats_add_moment(s_moments m, double x)
+{
+    return stats_add_weighted_moment(m, x, 1.0);
+}
+
+static inline s_moments stats_merge_moments(s_moments A, s_moments B)
+{
+    if (A.W == 0) { B.N += A.N; return B; }
+    if (B.W == 0) { A.N += B.N; return A; }
+
+    double Wa = A.W, Wb = B.W, W = Wa + Wb;
+    double d = B.mu - A.mu, dW = d / W;
+    s_moments out = { .N = A.N + B.N, .W = W, .W2 = A.W2 + B.W2, .mu = A.mu + Wb*dW };
+    out.M2 = A.M2 + B.M2 + d*dW*Wa*Wb;
+    out.M3 = A.M3 + B.M3 + d*dW*dW*Wa*Wb*(Wa - Wb) + 3*dW*(Wa*B.M2 - Wb*A.M2);
+    out.M4 = A.M4 + B.M4 + d*dW*dW*dW*Wa*Wb*(Wa*Wa - Wa*Wb + Wb*Wb) 
+           + 6*dW*dW*(Wa*Wa*B.M2 + Wb*Wb*A.M2) + 4*dW*(Wa*B.M3 - Wb*A.M3);
+    return out;
+}
+
+
+static inline s_moments stats_block_moments(const double *x, const double *w, int n)
+{   /* Two-pass block summary, as stats_block_sample. w can be NULL (all weights 1). n in [1, STATS_BLOCK] */
+    double accw[STATS_LANES] = {0}, accx[STATS_LANES] = {0}, accw2[STATS_LANES] = {0};
+    int i = 0;
+    for (; i + STATS_LANES <= n; i += STATS_LANES) {
+        for (int l = 0; l < STATS_LANES; l++) {
+            double wi = w ? w[i + l] : 1.0;
+            accw[l] += wi;
+            accw2[l] += wi * wi;
+            accx[l] += wi * x[i + l];
+        }
+    }
+    double W = 0, W2 = 0, sx = 0;
+    for (int l = 0; l < STATS_LANES; l++) { W += accw[l]; W2 += accw2[l]; sx += accx[l]; }
+    for (; i < n; i++) {
+        double wi = w ? w[i] : 1.0;
+        W += wi; W2 += wi * wi; sx += wi * x[i];
+    }
+    if (W == 0) return (s_moments){ .N = n };
+    double mu = sx / W;
+
+    double a1[STATS_LANES] = {0}, a2[STATS_LANES] = {0}, a3[STATS_LANES] = {0}, a4[STATS_LANES] = {0};
+    for (i = 0; i + STATS_LANES <= n; i += STATS_LANES) {
+        for (int l = 0; l < STATS_LANES; l++) {
+            double wi = w ? w[i + l] : 1.0;
+            double d = x[i + l] - mu, d2 = d * d;
+            a1[l] += wi * d;
+            a2[l] += wi * d2;
+            a3[l] += wi * d2 * d;
+            a4[l] += wi * d2 * d2;
+        }
+    }
+    double S1 = 0, S2 = 0, S3 = 0, S4 = 0;
+    for (int l = 0; l < STATS_LANES; l++) { S1 += a1[l]; S2 += a2[l]; S3 += a3[l]; S4 += a4[l]; }
+    for (; i < n; i++) {
+        double wi = w ? w[i] : 1.0;
+        double d = x[i] - mu, d2 = d * d;
+        S1 += wi * d; S2 += wi * d2; S3 += wi * d2 * d; S4 += wi * d2 * d2;
+    }
+
+    /* Shift the sums to the corrected mean mu + e */
+    double e = S1 / W;
+    return (s_moments){ .N = n, .W = W, .W2 = W2, .mu = mu + e,
+                        .M2 = S2 - W*e*e,
+                        .M3 = S3 - 3*e*S2 + 2*W*e*e*e,
+                        .M4 = S4 - 4*e*S3 + 6*e*e*S2 - 3*W*e*e*e*e };
+}
+
+static inline s_moments stats_add_weighted_array_moments(s_moments m, const double *x, const double *w, size_t n)
+{   /* w can be NULL. Blocks merged pairwise, as in stats_add_array */
+    s_moments levels[64];
+    int nlevels = 0;
+    for (size_t i = 0; i < n; i += STATS_BLOCK) {
+        int len = n - i < STATS_BLOCK ? (int)(n - i) : STATS_BLOCK;
+        s_moments carry = stats_block_moments(x + i, w ? w + i : NULL, len);
+        int k = 0;
+        for (; k < nlevels && levels[k].N > 0; k++) {
+            carry = stats_merge_moments(levels[k], carry);
+            levels[k] = (s_moments){0};
+        }
+        if (k == nlevels) nlevels++;
+        levels[k] = carry;
+    }
+    for (int k = 0; k < nlevels; k++) m = stats_merge_moments(m, levels[k]);
+    return m;
+}
+
+static inline s_moments stats_add_array_moments(s_moments m, const double *x, size_t n)
+{
+    return stats_add_weighted_array_moments(m, x, NULL, n);
+}
+
+#ifdef _OPENMP
+#pragma omp declare reduction(stats_merge : s_moments : omp_out = stats_merge_moments(omp_out, omp_in)) initializer(omp_priv = stats_init_moments())
+#endif
+
+
+static inline double stats_moments_mean(s_moments m)
+{
+    return m.mu;
+}
+
+static inline double stats_moments_variance(s_moments m, e_stats_type type, e_stats_weights weights)
+{
+    switch (type) {
+        case STATS_POPULATION:
+            return m.W == 0 ? 0 : m.M2 / m.W;
+
+        case STATS_SAMPLE: {
+            double denominator = weights == STATS_FREQUENCY_WEIGHTS ? m.W - 1 : m.W - m.W2 / m.W;
+            return (m.W == 0 || denominator <= 0) ? 0 : m.M2 / denominator;
+        }
+    }
+    return 0;
+}
+
+static inline double stats_moments_skewness(s_moments m)
+{   /* Population skewness g1 */
+    if (m.M2 <= 0) return 0;
+    return sqrt(m.W) * m.M3 / pow(m.M2, 1.5);
+}
+
+static inline double stats_moments_kurtosis(s_moments m)
+{   /* Population excess kurtosis g2 (0 for a normal distribution) */
+    if (m.M2 <= 0) return 0;
+    return m.W * m.M4 / (m.M2 * m.M2) - 3.0;
+}
+
+
+
+
+
+/* Streaming quantiles with a merging t-digest (Dunning & Ertl, 2019). Values are appended to a
+ * buffer; when it fills, buffer and centroids are sorted together and merged greedily so that 
+ * every centroid spans at most one unit of two scale functions: k1(q) = d/(2 pi) asin(2q - 1), 
+ * which bounds the absolute rank error around the median, and the logistic 
+ * k2(q) = d/Z log(q/(1-q)) with Z = 4 log(n/d) + 24, which keeps the tail centroids nearly 
+ * singletons and gives a roughly constant relative error on q and 1-q (d = compression).
+ * Memory is fixed: at most ~2*compression centroids plus a buffer of 5*compression values, so
+ * inserts are O(1) amortised. With compression = 100 and 1e7 values the rank error is ~1e-3 
+ * around the median and ~1e-5 beyond q = 0.999. Digests merge by feeding one's centroids to 
+ * the other. */
+#define STATS_TDIGEST_DEFAULT_COMPRESSION 100
+
+typedef struct tdigest_centroid {
+    double mean;
+    double weight;
+} s_tdigest_centroid;
+
+typedef struct tdigest {
+    double compression;
+    int ncentroids, max_centroids;
+    s_tdigest_centroid *centroids;   /* Sorted by mean */
+    int nbuffer, max_buffer;
+    s_tdigest_centroid *buffer;      /* Values not merged yet */
+    s_tdigest_centroid *scratch;     /* max_centroids + max_buffer, used while compressing */
+    double total_weight;             /* Centroids and buffer */
+    double min, max;
+} s_tdigest;
+
+
+static inline int stats_tdigest_init(s_tdigest *td, double compression)
+{   /* compression <= 0 for default. 0 ERROR, 1 OK */
+    memset(td, 0, sizeof(*td));
+    if (compression <= 0) compression = STATS_TDIGEST_DEFAULT_COMPRESSION;
+    td->compression = compression;
+    td->max_centroids = 2 * (int)ceil(compression) + 10;
+    td->max_buffer = 5 * (int)ceil(compression);
+    td->centroids = malloc(td->max_centroids * sizeof(s_tdigest_centroid));
+    td->buffer = malloc(td->max_buffer * sizeof(s_tdigest_centroid));
+    td->scratch = malloc((td->max_centroids + td->max_buffer) * sizeof(s_tdigest_centroid));
+    td->min = INFINITY;
+    td->max = -INFINITY;
+    if (!td->centroids || !td->buffer || !td->scratch) {
+        free(td->centroids); free(td->buffer); free(td->scratch);
+        memset(td, 0, sizeof(*td));
+        return 0;
+    }
+    return 1;
+}
+
+static inline void stats_tdigest_free(s_tdigest *td)
+{
+    if (!td) return;
+    free(td->centroids);
+    free(td->buffer);
+    free(td->scratch);
+    memset(td, 0, sizeof(*td));
+}
+
+static inline int stats_tdigest_cmp(const void *a, const void *b)
+{
+    double x = ((const s_tdigest_centroid*)a)->mean, y = ((const s_tdigest_centroid*)b)->mean;
+    return (x > y) - (x < y);
+}
+
+static inline double stats_tdigest_qlimit(double q0, double compression, double n)
+{   /* Largest q such that k(q) - k(q0) <= 1 for both scales (see above) */
+    double k1 = compression / (2 * STATS_PI) * asin(2 * q0 - 1) + 1;
+    double q1 = k1 >= compression / 4 ? 1.0 : (sin(k1 * 2 * STATS_PI / compression) + 1) / 2;
+
+    double Z = 4 * log(n / compression) + 24;
+    if (!(Z > 0)) return q1;
+    double k2 = compression / Z * log(fmax(q0, 0.5 / n) / (1 - q0)) + 1;
+    double q2 = q0 >= 1 ? 1.0 : 1 / (1 + exp(-k2 * Z / compression));
+    return fmin(q1, q2);
+}
+
+static inline void stats_tdigest_compress(s_tdigest *td)
+{
+    if (td->nbuffer == 0) return;
+    qsort(td->buffer, td->nbuffer, sizeof(s_tdigest_centroid), stats_tdigest_cmp);
+
+    /* Merge the two sorted lists into scratch */
+    s_tdigest_centroid *all = td->scratch;
+    int n = 0, i = 0, j = 0;
+    while (i < td->ncentroids || j < td->nbuffer) {
+        if (j >= td->nbuffer || (i < td->ncentroids && td->centroids[i].mean <= td->buffer[j].mean)) all[n++] = td->centroids[i++];
+        else all[n++] = td->buffer[j++];
+    }
+
+    /* Greedy merge under the scale function */
+    double W = td->total_weight, so_far = 0;
+    double q_limit = stats_tdigest_qlimit(0, td->compression, W) * W;
+    int m = 0;
+    td->centroids[0] = all[0];
+    so_far = all[0].weight;
+    for (int k = 1; k < n; k++) {
+        s_tdigest_centroid *cur = &td->centroids[m];
+        if (so_far + all[k].weight <= q_limit || m == td->max_centroids - 1) {
+            cur->weight += all[k].weight;
+            cur->mean += (all[k].mean - cur->mean) * all[k].weight / cur->weight;
+        } else {
+            q_limit = stats_tdigest_qlimit(so_far / W, td->compression, W) * W;
+            td->centroids[++m] = all[k];
+        }
+        so_far += all[k].weight;
+    }
+    td->ncentroids = m + 1;
+    td->nbuffer = 0;
+}
+
+static inline void stats_tdigest_add_weighted(s_tdigest *td, double x, double w)
+{
+    if (!(w > 0) || isnan(x)) return;
+    if (td->nbuffer == td->max_buffer) stats_tdigest_compress(td);
+    td->buffer[td->nbuffer++] = (s_tdigest_centroid){ .mean = x, .weight = w };
+    td->total_weight += w;
+    if (x < td->min) td->min = x;
+    if (x > td->max) td->max = x;
+}
+
+static inline void stats_tdigest_add(s_tdigest *td, double x)
+{
+    stats_tdigest_add_weighted(td, x, 1.0);
+}
+
+static inline void stats_tdigest_merge(s_tdigest *td, const s_tdigest *other)
+{   /* td absorbs other, which is not modified */
+    for (int i = 0; i < other->ncentroids; i++) stats_tdigest_add_weighted(td, other->centroids[i].mean, other->centroids[i].weight);
+    for (int i = 0; i < other->nbuffer; i++) stats_tdigest_add_weighted(td, other->buffer[i].mean, other->buffer[i].weight);
+    if (other->min < td->min) td->min = other->min;
+    if (other->max > td->max) td->max = other->max;
+}
+
+static inline double stats_tdigest_count(const s_tdigest *td)
+{
+    return td->total_weight;
+}
+
+static inline double stats_tdigest_quantile(s_tdigest *td, double q)
+{   /* Interpolates between centroid centres; the outer halves of the extreme centroids go to min and max */
+    stats_tdigest_compress(td);
+    int n = td->ncentroids;
+    if (n == 0) return NAN;
+    if (q <= 0) return td->min;
+    if (q >= 1) return td->max;
+    if (n == 1) return td->centroids[0].mean;
+
+    const s_tdigest_centroid *c = td->centroids;
+    double index = q * td->total_weight;
+    if (index < c[0].weight / 2) return td->min + (c[0].mean - td->min) * index / (c[0].weight / 2);
+    double so_far = c[0].weight / 2;
+    for (int i = 0; i < n - 1; i++) {
+        double dw = (c[i].weight + c[i+1].weight) / 2;
+        if (so_far + dw > index) {
+            double z1 = index - so_far, z2 = so_far + dw - index;
+            return (c[i].mean * z2 + c[i+1].mean * z1) / dw;
+        }
+        so_far += dw;
+    }
+    double z = index - so_far;
+    return c[n-1].mean + (td->max - c[n-1].mean) * z / (c[n-1].weight / 2);
+}
+
+static inline double stats_tdigest_cdf(s_tdigest *td, double x)
+{   /* Fraction of the weight below x, inverse of stats_tdigest_quantile */
+    stats_tdigest_compress(td);
+    int n = td->ncentroids;
+    if (n == 0) return NAN;
+    if (x < td->min) return 0;
+    if (x >= td->max) return 1;
+    const s_tdigest_centroid *c = td->centroids;
+    double W = td->total_weight;
+    if (n == 1) return td->max > td->min ? (x - td->min) / (td->max - td->min) : 0.5;
+
+    if (x < c[0].mean) return (c[0].weight / 2) * (x - td->min) / (c[0].mean - td->min) / W;
+    double so_far = c[0].weight / 2;
+    for (int i = 0; i < n - 1; i++) {
+        double dw = (c[i].weight + c[i+1].weight) / 2;
+        if (x < c[i+1].mean) {
+            double span = c[i+1].mean - c[i].mean;
+            return (so_far + (span > 0 ? dw * (x - c[i].mean) / span : dw / 2)) / W;
+        }
+        so_far += dw;
+    }
+    return (so_far + (c[n-1].weight / 2) * (x - c[n-1].mean) / (td->max - c[n-1].mean)) / W;
+}
+
+
+/* Serialisation, e.g. to merge digests across MPI ranks: 
+ * [compression][min][max][ncentroids (as double)][mean, weight]... */
+static inline size_t stats_tdigest_serialized_size(s_tdigest *td)
+{
+    stats_tdigest_compress(td);
+    return (4 + 2 * (size_t)td->ncentroids) * sizeof(double);
+}
+
+static inline size_t stats_tdigest_serialize(s_tdigest *td, void *out)
+{   /* out needs stats_tdigest_serialized_size bytes. Returns bytes written */
+    size_t size = stats_tdigest_serialized_size(td);
+    double header[4] = { td->compression, td->min, td->max, td->ncentroids };
+    memcpy(out, header, sizeof(header));
+    memcpy((char*)out + sizeof(header), td->centroids, td->ncentroids * sizeof(s_tdigest_centroid));
+    return size;
+}
+
+static inline int stats_tdigest_merge_serialized(s_tdigest *td, const void *in, size_t size)
+{   /* td absorbs a serialised digest. 0 if ERROR (malformed input) */
+    double header[4];
+    if (size < sizeof(header)) return 0;
+    memcpy(header, in, sizeof(header));
+    double max_n = (double)((size - sizeof(header)) / sizeof(s_tdigest_centroid));
+    if (!(header[3] >= 0 && header[3] <= max_n)) return 0;  /* Also rejects NaN, before converting */
+    size_t n = header[3];
+    if ((double)n != header[3] || size != sizeof(header) + n * sizeof(s_tdigest_centroid)) return 0;
+    const char *p = (const char*)in + sizeof(header);
+    for (size_t i = 0; i < n; i++) {
+        s_tdigest_centroid c;
+        memcpy(&c, p + i * sizeof(c), sizeof(c));
+        stats_tdigest_add_weighted(td, c.mean, c.weight);
+    }
+    if (n > 0 && header[1] < td->min) td->min = header[1];
+    if (n > 0 && header[2] > td->max) td->max = header[2];
+    return 1;
+}
+
+
+
+
+
+/* High dynamic range histogram (after Gil Tene's HdrHistogram) for hot path latencies. 
+ * Integer values in [lowest, highest] are kept with a relative precision of 
+ * significant_figures decimal digits: values are split into power-of-two buckets, each with 
+ * 2 * 10^significant_figures linear sub-buckets (the lower half of each bucket overlaps the 
+ * previous one and is not stored). Recording is one clz, two shifts and an increment; memory
+ * is fixed at init, e.g. 270 kB for 1 ns to 1 hour with 3 significant figures.
+ * Instances are not thread-safe: give each thread its own and merge them, or use 
+ * stats_hdr_record_atomic on a shared one. */
+typedef struct hdr_histogram {
+    int64_t lowest, highest;
+    int significant_figures;
+    int unit_magnitude;                    /* floor(log2(lowest)) */
+    int sub_bucket_half_count_magnitude;
+    int64_t sub_bucket_count, sub_bucket_half_count, sub_bucket_mask;
+    int bucket_count;
+    int64_t counts_len;
+    int64_t total_count;
+    int64_t *counts;
+} s_hdr_histogram;
+
+
+static inline int stats_hdr_init(s_hdr_histogram *h, int64_t lowest, int64_t highest, int significant_figures)
+{   /* Tracks values in [lowest, highest] (lowest >= 1, highest >= 2*lowest) with 1 to 5 
+     * significant figures. 0 ERROR, 1 OK */
+    memset(h, 0, sizeof(*h));
+    if (lowest < 1 || highest < 2 * lowest || significant_figures < 1 || significant_figures > 5) {
+        fprintf(stderr, "stats_hdr_init: invalid range or precision.\n");
+        return 0;
+    }
+    int64_t largest_single_unit = 2;
+    for (int i = 0; i < significant_figures; i++) largest_single_unit *= 10;
+    int sub_bucket_count_magnitude = (int)ceil(log2((double)largest_single_unit));
+    h->lowest = lowest;
+    h->highest = highest;
+    h->significant_figures = significant_figures;
+    h->unit_magnitude = 63 - __builtin_clzll(lowest);
+    if (h->unit_magnitude + sub_bucket_count_magnitude > 62) {
+        fprintf(stderr, "stats_hdr_init: lowest too large for the requested precision.\n");
+        return 0;
+    }
+    h->sub_bucket_half_count_magnitude = sub_bucket_count_magnitude - 1;
+    h->sub_bucket_count = (int64_t)1 << sub_bucket_count_magnitude;
+    h->sub_bucket_half_count = h->sub_bucket_count / 2;
+    h->sub_bucket_mask = (h->sub_bucket_count - 1) << h->unit_magnitude;
+
+    int64_t smallest_untrackable = h->sub_bucket_count << h->unit_magnitude;
+    int buckets = 1;
+    while (smallest_untrackable <= highest) {
+        if (smallest_untrackable > INT64_MAX / 2) { buckets++; break; }
+        smallest_untrackable <<= 1;
+        buckets++;
+    }
+    h->bucket_count = buckets;
+    h->counts_len = (int64_t)(buckets + 1) * h->sub_bucket_half_count;
+    h->counts = calloc(h->counts_len, sizeof(int64_t));
+    if (!h->counts) {
+        fprintf(stderr, "stats_hdr_init: out of memory.\n");
+        return 0;
+    }
+    return 1;
+}
+
+static inline void stats_hdr_free(s_hdr_histogram *h)
+{
+    if (!h) return;
+    free(h->counts);
+    memset(h, 0, sizeof(*h));
+}
+
+static inline void stats_hdr_reset(s_hdr_histogram *h)
+{
+    memset(h->counts, 0, h->counts_len * sizeof(int64_t));
+    h->total_count = 0;
+}
+
+static inline int64_t stats_hdr_index(const s_hdr_histogram *h, int64_t value)
+{   /* Position of value in counts (may be >= counts_len if value is out of range) */
+    int pow2ceiling = 64 - __builtin_clzll((uint64_t)value | h->sub_bucket_mask);
+    int bucket = pow2ceiling - h->unit_magnitude - (h->sub_bucket_half_count_magnitude + 1);
+    int64_t sub_bucket = value >> (bucket + h->unit_magnitude);
+    return ((int64_t)(bucket + 1) << h->sub_bucket_half_count_magnitude) + sub_bucket - h->sub_bucket_half_count;
+}
+
+static inline int64_t stats_hdr_value_at_index(const s_hdr_histogram *h, int64_t index)
+{   /* Lowest value that maps to index */
+    int bucket = (int)(index >> h->sub_bucket_half_count_magnitude) - 1;
+    int64_t sub_bucket = (index & (h->sub_bucket_half_count - 1)) + h->sub_bucket_half_count;
+    if (bucket < 0) {
+        sub_bucket -= h->sub_bucket_half_count;
+        bucket = 0;
+    }
+    return sub_bucket << (bucket + h->unit_magnitude);
+}
+
+static inline int64_t stats_hdr_equivalent_range(const s_hdr_histogram *h, int64_t value)
+{   /* Number of consecutive values that share value's counter */
+    int pow2ceiling = 64 - __builtin_clzll((uint64_t)value | h->sub_bucket_mask);
+    int bucket = pow2ceiling - h->unit_magnitude - (h->sub_bucket_half_count_magnitude + 1);
+    int64_t sub_bucket = value >> (bucket + h->unit_magnitude);
+    if (sub_bucket >= h->sub_bucket_count) bucket++;
+    return (int64_t)1 << (h->unit_magnitude + bucket);
+}
+
+static inline int stats_hdr_record_n(s_hdr_histogram *h, int64_t value, int64_t count)
+{   /* 0 if value is out of range (not recorded), 1 OK */
+    if (value < 0) return 0;
+    int64_t i = stats_hdr_index(h, value);
+    if (i >= h->counts_len) return 0;
+    h->counts[i] += count;
+    h->total_count += count;
+    return 1;
+}
+
+static inline int stats_hdr_record(s_hdr_histogram *h, int64_t value)
+{   /* 0 if value is out of range (not recorded), 1 OK */
+    return stats_hdr_record_n(h, value, 1);
+}
+
+static inline int stats_hdr_record_atomic(s_hdr_histogram *h, int64_t value)
+{   /* Same as stats_hdr_record, safe to call concurrently on a shared histogram */
+    if (value < 0) return 0;
+    int64_t i = stats_hdr_index(h, value);
+    if (i >= h->counts_len) return 0;
+    __atomic_fetch_add(&h->counts[i], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->total_count, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+static inline int64_t stats_hdr_merge(s_hdr_histogram *h, const s_hdr_histogram *other)
+{   /* Adds other's counts to h. If both have the same layout this is a plain sum of arrays, 
+     * otherwise every non-empty counter of other is recorded again in h at its midpoint.
+     * Returns the number of values of other that did not fit in h's range */
+    if (h->unit_magnitude == other->unit_magnitude && h->sub_bucket_count == other->sub_bucket_count) {
+        int64_t n = h->counts_len < other->counts_len ? h->counts_len : other->counts_len;
+        for (int64_t i = 0; i < n; i++) h->counts[i] += other->counts[i];
+        h->total_count = 0;
+        for (int64_t i = 0; i < h->counts_len; i++) h->total_count += h->counts[i];
+        int64_t dropped = 0;
+        for (int64_t i = n; i < other->counts_len; i++) dropped += other->counts[i];
+        return dropped;
+    }
+    int64_t dropped = 0;
+    for (int64_t i = 0; i < other->counts_len; i++) {
+        if (other->counts[i] == 0) continue;
+        int64_t v = stats_hdr_value_at_index(other, i);
+        v += stats_hdr_equivalent_range(other, v) / 2;
+        if (!stats_hdr_record_n(h, v, other->counts[i])) dropped += other->counts[i];
+    }
+    return dropped;
+}
+
+static inline int64_t stats_hdr_count(const s_hdr_histogram *h)
+{
+    return h->total_count;
+}
+
+static inline int64_t stats_hdr_min(const s_hdr_histogram *h)
+{   /* Lowest value equivalent to the smallest recorded one. 0 if empty */
+    for (int64_t i = 0; i < h->counts_len; i++) 
+        if (h->counts[i]) return stats_hdr_value_at_index(h, i);
+    return 0;
+}
+
+static inline int64_t stats_hdr_max(const s_hdr_histogram *h)
+{   /* Highest value equivalent to the largest recorded one. 0 if empty */
+    for (int64_t i = h->counts_len - 1; i >= 0; i--) {
+        if (h->counts[i] == 0) continue;
+        int64_t v = stats_hdr_value_at_index(h, i);
+        return v + stats_hdr_equivalent_range(h, v) - 1;
+    }
+    return 0;
+}
+
+static inline double stats_hdr_mean(const s_hdr_histogram *h)
+{   /* Mean using the midpoint of every counter. NAN if empty */
+    if (h->total_count == 0) return NAN;
+    double sum = 0;
+    for (int64_t i = 0; i < h->counts_len; i++) {
+        if (h->counts[i] == 0) continue;
+        int64_t v = stats_hdr_value_at_index(h, i);
+        sum += h->counts[i] * (v + 0.5 * (stats_hdr_equivalent_range(h, v) - 1));
+    }
+    return sum / h->total_count;
+}
+
+static inline int64_t stats_hdr_value_at_percentile(const s_hdr_histogram *h, double percentile)
+{   /* Smallest value v such that at least percentile % of the values are <= v, rounded up to 
+     * the highest value sharing its counter (as HdrHistogram does). 0 if empty */
+    if (h->total_count == 0) return 0;
+    if (percentile > 100) percentile = 100;
+    int64_t target = (int64_t)(percentile / 100 * h->total_count + 0.5);
+    if (target < 1) target = 1;
+    int64_t so_far = 0;
+    for (int64_t i = 0; i < h->counts_len; i++) {
+        so_far += h->counts[i];
+        if (so_far >= target) {
+            int64_t v = stats_hdr_value_at_index(h, i);
+            return v + stats_hdr_equivalent_range(h, v) - 1;
+        }
+    }
+    return stats_hdr_max(h);
+}
+
+
+/* Compact serialisation: a header with the configuration followed by the counts as LEB128 
+ * varints of their zigzag encoding, where a run of k empty counters is written as -k. Only
+ * the occupied range costs space: ~2 bytes per non-empty counter. */
+#define STATS_HDR_MAGIC 0x48445231u   /* "HDR1" */
+
+static inline size_t stats_hdr_serialized_bound(const s_hdr_histogram *h)
+{   /* Upper bound on the bytes written by stats_hdr_serialize */
+    return 4 + 4 + 3 * 8 + (size_t)h->counts_len * 10;
+}
+
+static inline size_t stats_hdr_put_varint(uint8_t *out, int64_t x)
+{
+    uint64_t z = ((uint64_t)x << 1) ^ (uint64_t)(x >> 63);
+    size_t n = 0;
+    while (z >= 0x80) { out[n++] = (uint8_t)(z | 0x80); z >>= 7; }
+    out[n++] = (uint8_t)z;
+    return n;
+}
+
+static inline size_t stats_hdr_get_varint(const uint8_t *in, size_t size, int64_t *x)
+{   /* Returns bytes consumed, 0 if malformed */
+    uint64_t z = 0;
+    for (size_t n = 0; n < size && n < 10; n++) {
+        z |= (uint64_t)(in[n] & 0x7f) << (7 * n);
+        if (!(in[n] & 0x80)) {
+            *x = (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+static inline size_t stats_hdr_serialize(const s_hdr_histogram *h, void *out)
+{   /* out needs stats_hdr_serialized_bound bytes. Returns bytes written */
+    uint8_t *p = out;
+    uint32_t header[2] = { STATS_HDR_MAGIC, (uint32_t)h->significant_figures };
+    int64_t range[3] = { h->lowest, h->highest, h->total_count };
+    memcpy(p, header, sizeof(header));
+    memcpy(p + sizeof(header), range, sizeof(range));
+    size_t n = sizeof(header) + sizeof(range);
+    for (int64_t i = 0; i < h->counts_len; ) {
+        if (h->counts[i] == 0) {
+            int64_t run = 0;
+            while (i < h->counts_len && h->counts[i] == 0) { run++; i++; }
+            n += stats_hdr_put_varint(p + n, -run);
+        } else {
+            n += stats_hdr_put_varint(p + n, h->counts[i++]);
+        }
+    }
+    return n;
+}
+
+static inline int stats_hdr_deserialize(s_hdr_histogram *h, const void *in, size_t size)
+{   /* Initialises h from a serialised histogram (free it with stats_hdr_free). 0 ERROR, 1 OK */
+    const uint8_t *p = in;
+    uint32_t header[2];
+    int64_t range[3];
+    if (size < sizeof(header) + sizeof(range)) goto malformed;
+    memcpy(header, p, sizeof(header));
+    memcpy(range, p + sizeof(header), sizeof(range));
+    if (header[0] != STATS_HDR_MAGIC) goto malformed;
+    if (!stats_hdr_init(h, range[0], range[1], (int)header[1])) return 0;
+
+    size_t n = sizeof(header) + sizeof(range);
+    int64_t i = 0, total = 0;
+    while (n < size) {
+        int64_t x;
+        size_t used = stats_hdr_get_varint(p + n, size - n, &x);
+        if (used == 0) { stats_hdr_free(h); goto malformed; }
+        n += used;
+        if (x < 0) {  /* Run of zeros, must stay inside counts (also rejects INT64_MIN) */
+            if (x < -(h->counts_len - i)) { stats_hdr_free(h); goto malformed; }
+            i -= x;
+        } else {
+            if (i >= h->counts_len || x > INT64_MAX - total) { stats_hdr_free(h); goto malformed; }
+            h->counts[i++] = x;
+            total += x;
+        }
+    }
+    if (i > h->counts_len || total != range[2]) { stats_hdr_free(h); goto malformed; }
+    h->total_count = total;
+    return 1;
+
+malformed:
+    fprintf(stderr, "stats_hdr_deserialize: malformed input.\n");
+    return 0;
+}
+
+
+static inline int64_t stats_now_ns(void)
+{   /* Monotonic clock in nanoseconds, to time the values fed to stats_hdr_record */
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+
+
+
+
+/* Multivariate samples: mean vector and co-moment matrix C = sum (x - mu)(x - mu)^T of 
+ * d-dimensional observations, in O(d^2) memory regardless of the number of samples. 
+ * stats_multi_add is the Welford rank-1 update. stats_multi_add_array summarises blocks of 
+ * STATS_MULTI_BLOCK observations with a two-pass mean and the product Y^T Y of the centred 
+ * block, computed in register tiles like a matrix-matrix kernel, and merges each block into
+ * the accumulator (Chan et al.). Only the upper triangle of C (j >= i) is maintained. */
+#define STATS_MULTI_BLOCK 256  /* Observations per block */
+#ifdef __AVX__
+#define STATS_VEC 4            /* Doubles per vector register */
+#else
+#define STATS_VEC 2
+#endif
+typedef double stats_vec __attribute__((vector_size(STATS_VEC * sizeof(double))));
+
+typedef struct multisample {
+    int d;
+    int64_t N;
+    double *mu;          /* [d] */
+    double *C;           /* [d*d] row-major co-moments, upper triangle */
+    double *work;        /* Scratch: centred block, block mean and residuals, delta */
+} s_multisample;
+
+
+static inline int stats_multi_init(s_multisample *s, int d)
+{   /* 0 ERROR, 1 OK */
+    memset(s, 0, sizeof(*s));
+    if (d < 1) return 0;
+    s->d = d;
+    s->mu = calloc(d, sizeof(double));
+    s->C = calloc((size_t)d * d, sizeof(double));
+    s->work = calloc((size_t)((d + 7) & ~7) * STATS_MULTI_BLOCK + 3 * (size_t)d, sizeof(double));
+    if (!s->mu || !s->C || !s->work) {
+        free(s->mu); free(s->C); free(s->work);
+        memset(s, 0, sizeof(*s));
+        fprintf(stderr, "stats_multi_init: out of memory.\n");
+        return 0;
+    }
+    return 1;
+}
+
+static inline void stats_multi_free(s_multisample *s)
+{
+    if (!s) return;
+    free(s->mu);
+    free(s->C);
+    free(s->work);
+    memset(s, 0, sizeof(*s));
+}
+
+static inline void stats_multi_add(s_multisample *s, const double *x)
+{   /* x[d] */
+    int d = s->d;
+    double *delta = s->work;
+    s->N++;
+    double f = (double)(s->N - 1) / s->N;
+    for (int i = 0; i < d; i++) {
+        delta[i] = x[i] - s->mu[i];
+        s->mu[i] += delta[i] / s->N;
+    }
+    for (int i = 0; i < d; i++) {
+        double fi = f * delta[i];
+        double *Ci = s->C + (size_t)i * d;
+        for (int j = i; j < d; j++) Ci[j] += fi * delta[j];
+    }
+}
+
+static inline void stats_multi_merge_parts(s_multisample *s, int64_t N, const double *mu, const double *C)
+{   /* Merges N observations with mean mu and co-moments C (upper triangle) into s */
+    if (N == 0) return;
+    int d = s->d;
+    int64_t N_AB = s->N + N;
+    double f = (double)s->N * N / N_AB;
+    double *delta = s->work + (size_t)((d + 7) & ~7) * STATS_MULTI_BLOCK + 2 * d;
+    for (int i = 0; i < d; i++) delta[i] = mu[i] - s->mu[i];
+    for (int i = 0; i < d; i++) {
+        double fi = f * delta[i];
+        double *Ci = s->C + (size_t)i * d;
+        const double *Bi = C + (size_t)i * d;
+        for (int j = i; j < d; j++) Ci[j] += Bi[j] + fi * delta[j];
+    }
+    for (int i = 0; i < d; i++) s->mu[i] += delta[i] * N / N_AB;
+    s->N = N_AB;
+}
+
+static inline int stats_multi_merge(s_multisample *s, const s_multisample *other)
+{   /* s absorbs other. 0 if ERROR (different dimensions) */
+    if (s->d != other->d) {
+        fprintf(stderr, "stats_multi_merge: dimensions differ.\n");
+        return 0;
+    }
+    stats_multi_merge_parts(s, other->N, other->mu, other->C);
+    return 1;
+}
+
+static inline int stats_multi_add_array(s_multisample *s, const double *X, size_t n)
+{   /* X[n*d], one observation per row. 0 if ERROR (out of memory) */
+    int d = s->d;
+    int ld = (d + 7) & ~7;                          /* Row length of Y, padded with zeros */
+    double *Y = s->work;                            /* [STATS_MULTI_BLOCK][ld], centred block */
+    double *mb = s->work + (size_t)ld * STATS_MULTI_BLOCK;
+    double *res = mb + d;
+    double *Cb = malloc((size_t)d * d * sizeof(double));
+    if (!Cb) { fprintf(stderr, "stats_multi_add_array: out of memory.\n"); return 0; }
+
+    for (size_t b = 0; b < n; b += STATS_MULTI_BLOCK) {
+        int m = n - b < STATS_MULTI_BLOCK ? (int)(n - b) : STATS_MULTI_BLOCK;
+        const double *Xb = X + b * d;
+
+        /* Two-pass block mean, with the residual correction of stats_block_sample */
+        for (int j = 0; j < d; j++) { mb[j] = 0; res[j] = 0; }
+        for (int k = 0; k < m; k++)
+            for (int j = 0; j < d; j++) mb[j] += Xb[(size_t)k * d + j];
+        for (int j = 0; j < d; j++) mb[j] /= m;
+        for (int k = 0; k < m; k++) {
+            for (int j = 0; j < d; j++) {
+                double y = Xb[(size_t)k * d + j] - mb[j];
+                Y[(size_t)k * ld + j] = y;
+                res[j] += y;
+            }
+        }
+
+        /* Cb = Y^T Y, upper triangle, in tiles of 4 x 2*STATS_VEC held in registers: each 
+         * observation adds the outer product of Y[k][i..i+4] and Y[k][j..j+2*STATS_VEC]. 
+         * Columns past d are computed on the zero padding of Y and discarded */
+        for (int i0 = 0; i0 < d; i0 += 4) {
+            for (int j0 = i0 & ~(2 * STATS_VEC - 1); j0 < d; j0 += 2 * STATS_VEC) {
+                stats_vec acc[4][2] = {{{0}}};
+                for (int k = 0; k < m; k++) {
+                    const double *y = Y + (size_t)k * ld;
+                    stats_vec b0, b1;
+                    memcpy(&b0, y + j0, sizeof(b0));
+                    memcpy(&b1, y + j0 + STATS_VEC, sizeof(b1));
+                    for (int r = 0; r < 4; r++) {
+                        acc[r][0] += y[i0 + r] * b0;
+                        acc[r][1] += y[i0 + r] * b1;
+                    }
+                }
+                for (int r = 0; r < 4 && i0 + r < d; r++)
+                    for (int c = 0; c < 2 * STATS_VEC && j0 + c < d; c++)
+                        Cb[(size_t)(i0 + r) * d + j0 + c] = acc[r][c / STATS_VEC][c % STATS_VEC] - res[i0 + r] * res[j0 + c] / m;
+            }
+        }
+        for (int j = 0; j < d; j++) mb[j] += res[j] / m;
+        stats_multi_merge_parts(s, m, mb, Cb);
+    }
+    free(Cb);
+    return 1;
+}
+
+static inline void stats_multi_mean(const s_multisample *s, double *out)
+{   /* out[d] */
+    memcpy(out, s->mu, s->d * sizeof(double));
+}
+
+static inline void stats_multi_covariance(const s_multisample *s, e_stats_type type, double *out)
+{   /* out[d*d], full symmetric matrix. Zero if there are not enough observations */
+    int d = s->d;
+    int64_t dof = type == STATS_SAMPLE ? s->N - 1 : s->N;
+    for (int i = 0; i < d; i++) {
+        for (int j = i; j < d; j++) {
+            double c = dof <= 0 ? 0 : s->C[(size_t)i * d + j] / dof;
+            out[(size_t)i * d + j] = c;
+            out[(size_t)j * d + i] = c;
+        }
+    }
+}
+
+static inline void stats_multi_correlation(const s_multisample *s, double *out)
+{   /* out[d*d], Pearson correlations (independent of e_stats_type). NAN where a variable has 
+     * zero variance */
+    int d = s->d;
+    for (int i = 0; i < d; i++) {
+        for (int j = i; j < d; j++) {
+            double vi = s->C[(size_t)i * d + i], vj = s->C[(size_t)j * d + j];
+            double r = vi > 0 && vj > 0 ? s->C[(size_t)i * d + j] / sqrt(vi * vj) : NAN;
+            if (i == j && vi > 0) r = 1;
+            out[(size_t)i * d + j] = r;
+            out[(size_t)j * d + i] = r;
+        }
+    }
+}
+
+
+
+
+
+/* Error of the mean of correlated series (e.g. Monte Carlo time series) by blocking 
+ * (Flyvbjerg & Petersen, 1989), done online: level k holds the averages of consecutive 
+ * blocks of 2^k values, each level pairing up the values of the one below, so a series of N
+ * values needs log2(N) levels and no storage. The naive error is correct once blocks are 
+ * longer than the correlation time. The level is chosen automatically with the criterion of
+ * Jonsson (2018), which tests whether the lag-1 autocorrelations left above a level are 
+ * compatible with zero. Each level therefore also keeps its lag-1 co-moment, computed on 
+ * values shifted by the first one. */
+#define STATS_BLOCKING_LEVELS 64
+
+typedef struct blocking_level {
+    s_sample sample;     /* Block averages of this level */
+    double shift;        /* First block average */
+    double lag;          /* sum (y_t - shift)(y_t+1 - shift) */
+    double last;         /* Last block average minus shift */
+    double pending;      /* Block average waiting for its pair */
+    bool has_pending;
+} s_blocking_level;
+
+typedef struct blocking {
+    int nlevels;
+    s_blocking_level levels[STATS_BLOCKING_LEVELS];
+} s_blocking;
+
+
+static inline void stats_blocking_init(s_blocking *b)
+{
+    memset(b, 0, sizeof(*b));
+}
+
+static inline void stats_blocking_add(s_blocking *b, double x)
+{   /* O(1) amortised */
+    for (int k = 0; k < STATS_BLOCKING_LEVELS; k++) {
+        s_blocking_level *L = &b->levels[k];
+        if (k == b->nlevels) b->nlevels++;
+        if (L->sample.N == 0) {
+            L->shift = x;
+            L->last = 0;
+        } else {
+            L->lag += L->last * (x - L->shift);
+            L->last = x - L->shift;
+        }
+        L->sample = stats_add_sample(L->sample, x);
+        if (!L->has_pending) {
+            L->pending = x;
+            L->has_pending = true;
+            return;
+        }
+        x = 0.5 * (L->pending + x);
+        L->has_pending = false;
+    }
+}
+
+static inline int stats_blocking_levels(const s_blocking *b)
+{   /* Number of levels with at least 2 block averages */
+    int n = 0;
+    while (n < b->nlevels && b->levels[n].sample.N >= 2) n++;
+    return n;
+}
+
+static inline double stats_blocking_mean(const s_blocking *b)
+{
+    return b->levels[0].sample.mu;
+}
+
+static inline double stats_blocking_error(const s_blocking *b, int level)
+{   /* Standard error of the mean estimated from the block averages of level. NAN if the 
+     * level has fewer than 2 of them */
+    if (level < 0 || level >= stats_blocking_levels(b)) return NAN;
+    s_sample s = b->levels[level].sample;
+    return sqrt(stats_variance(s, STATS_SAMPLE) / s.N);
+}
+
+static inline double stats_blocking_error_error(const s_blocking *b, int level)
+{   /* Statistical uncertainty of stats_blocking_error(b, level) */
+    if (level < 0 || level >= stats_blocking_levels(b)) return NAN;
+    return stats_blocking_error(b, level) / sqrt(2.0 * (b->levels[level].sample.N - 1));
+}
+
+static inline double stats_blocking_lag1(const s_blocking_level *L)
+{   /* Lag-1 autocovariance of the block averages (divided by N), from the shifted sums */
+    int64_t n = L->sample.N;
+    double m = L->sample.mu - L->shift;
+    double S1 = n * m;
+    /* sum_t (y_t - m)(y_t+1 - m) over t = 0..n-2, where y_0 = 0 and y_n-1 = last */
+    double sum = L->lag - m * (S1 - L->last) - m * S1 + (n - 1) * m * m;
+    return sum / n;
+}
+
+static inline int stats_blocking_optimal_level(const s_blocking *b)
+{   /* Smallest level j whose statistic M_j = sum_{i>=j} n_i (gamma_i / sigma_i^2)^2 is below 
+     * the 99% quantile of chi^2 with (levels - j) degrees of freedom. -1 if no level below 
+     * the last one qualifies, i.e. the series is too short for its correlation time */
+    int d = stats_blocking_levels(b);
+    double M[STATS_BLOCKING_LEVELS + 1];
+    M[d] = 0;
+    for (int i = d - 1; i >= 0; i--) {
+        const s_blocking_level *L = &b->levels[i];
+        double var = L->sample.M2 / L->sample.N;
+        double r = var > 0 ? stats_blocking_lag1(L) / var : 0;
+        M[i] = M[i + 1] + L->sample.N * r * r;
+    }
+    for (int j = 0; j < d - 1; j++) {
+        /* Wilson-Hilferty approximation of the chi^2 quantile, z = 2.326 for 99% */
+        double k = d - j, h = 2 / (9 * k);
+        double q = k * pow(1 - h + 2.326348 * sqrt(h), 3);
+        if (M[j] < q) return j;
+    }
+    return -1;
+}
+
+static inline double stats_blocking_error_mean(const s_blocking *b)
+{   /* Error of the mean at the optimal level. NAN if the series is too short */
+    return stats_blocking_error(b, stats_blocking_optimal_level(b));
+}
+
+static inline double stats_blocking_tau(const s_blocking *b)
+{   /* Integrated autocorrelation time, such that error^2 = 2 tau var / N (tau = 1/2 for 
+     * uncorrelated values). NAN if the series is too short */
+    double e = stats_blocking_error_mean(b), e0 = stats_blocking_error(b, 0);
+    return e0 > 0 ? 0.5 * (e / e0) * (e / e0) : NAN;
+}
+
+
+
+
+
+/* Sliding windows over the last W samples or the last T seconds. The window is a ring of 
+ * nblocks block summaries (s_sample) plus the block being filled, so old data leaves by 
+ * dropping whole blocks and never by reverse Welford updates. The ring is aggregated with 
+ * the two-stacks method: the older part keeps suffix merges, recomputed when it runs out, and
+ * the newer part a running merge, so adds and queries are O(1) amortised. The window covers
+ * the last W to W + W/nblocks - 1 samples (or T to T + T/nblocks seconds). */
+typedef struct window {
+    bool timed;
+    int nblocks;
+    int64_t block_size;  /* Samples per block (counted windows) */
+    double slice;        /* Seconds per block (timed windows) */
+
+    int64_t current_id;  /* Block being filled: its time slice (timed windows) */
+    s_sample current;
+
+    s_sample *blocks;    /* Ring of completed blocks, oldest at head */
+    int64_t *ids;
+    int head, count;
+    s_sample *front;     /* front[k]: merge of the ring from position k to the end of the older part */
+    int nfront;          /* Blocks in the older part */
+    s_sample back;       /* Merge of the newer part */
+} s_window;
+
+
+static inline int stats_window_alloc(s_window *w, int nblocks)
+{
+    w->nblocks = nblocks;
+    w->blocks = malloc(nblocks * sizeof(s_sample));
+    w->ids = malloc(nblocks * sizeof(int64_t));
+    w->front = malloc(nblocks * sizeof(s_sample));
+    if (!w->blocks || !w->ids || !w->front) {
+        free(w->blocks); free(w->ids); free(w->front);
+        memset(w, 0, sizeof(*w));
+        fprintf(stderr, "stats_window_init: out of memory.\n");
+        return 0;
+    }
+    return 1;
+}
+
+static inline int stats_window_init_count(s_window *w, int64_t W, int nblocks)
+{   /* Window over the last W samples, in nblocks blocks. 0 ERROR, 1 OK */
+    memset(w, 0, sizeof(*w));
+    if (W < 1 || nblocks < 1) return 0;
+    if (nblocks > W) nblocks = W;
+    w->block_size = (W + nblocks - 1) / nblocks;
+    return stats_window_alloc(w, nblocks);
+}
+
+static inline int stats_window_init_time(s_window *w, double T, int nblocks)
+{   /* Window over the last T seconds (or any time unit), in nblocks time slices. 0 ERROR, 1 OK */
+    memset(w, 0, sizeof(*w));
+    if (!(T > 0) || nblocks < 1) return 0;
+    w->timed = true;
+    w->slice = T / nblocks;
+    w->current_id = INT64_MIN;
+    return stats_window_alloc(w, nblocks);
+}
+
+static inline void stats_window_free(s_window *w)
+{
+    if (!w) return;
+    free(w->blocks);
+    free(w->ids);
+    free(w->front);
+    memset(w, 0, sizeof(*w));
+}
+
+static inline void stats_window_evict(s_window *w)
+{   /* Drops the oldest completed block */
+    if (w->count == 0) return;
+    if (w->nfront == 0) {
+        /* Flip: the whole ring becomes the older part */
+        int last = (w->head + w->count - 1) % w->nblocks;
+        w->front[last] = w->blocks[last];
+        for (int i = w->count - 2; i >= 0; i--) {
+            int k = (w->head + i) % w->nblocks;
+            w->front[k] = stats_merge_samples(w->blocks[k], w->front[(k + 1) % w->nblocks]);
+        }
+        w->nfront = w->count;
+        w->back = stats_init_sample();
+    }
+    w->head = (w->head + 1) % w->nblocks;
+    w->count--;
+    w->nfront--;
+}
+
+static inline void stats_window_push(s_window *w)
+{   /* Moves the current block into the ring */
+    if (w->current.N == 0) return;
+    if (w->count == w->nblocks) stats_window_evict(w);
+    int k = (w->head + w->count) % w->nblocks;
+    w->blocks[k] = w->current;
+    w->ids[k] = w->current_id;
+    w->count++;
+    w->back = stats_merge_samples(w->back, w->current);
+    w->current = stats_init_sample();
+}
+
+static inline void stats_window_advance(s_window *w, double now)
+{   /* Timed windows: drops the data older than the window at time now */
+    int64_t id = (int64_t)floor(now / w->slice);
+    if (id <= w->current_id) return;
+    stats_window_push(w);
+    w->current_id = id;
+    while (w->count > 0 && w->ids[w->head] < id - w->nblocks) stats_window_evict(w);
+}
+
+static inline void stats_window_add(s_window *w, double x)
+{   /* Counted windows */
+    w->current = stats_add_sample(w->current, x);
+    if (w->current.N == w->block_size) {
+        stats_window_push(w);
+        w->current_id++;
+    }
+}
+
+static inline void stats_window_add_at(s_window *w, double t, double x)
+{   /* Timed windows, t non-decreasing */
+    stats_window_advance(w, t);
+    w->current = stats_add_sample(w->current, x);
+}
+
+static inline s_sample stats_window_sample(const s_window *w)
+{   /* Samples in the window, use with stats_mean, stats_variance... For timed windows, call 
+     * stats_window_advance first if no data arrived recently */
+    s_sample s = stats_merge_samples(w->back, w->current);
+    if (w->nfront > 0) s = stats_merge_samples(w->front[w->head], s);
+    return s;
+}
+
+
+
+
+/* Exponentially weighted mean and variance (Finch, 2009). With half-life h, a value's weight 
+ * halves every h samples (alpha = 1 - 2^(-1/h)), or every h time units when added with 
+ * stats_add_ewma_at. The variance is the weighted population variance of the history.
+ * stats_add_array_ewma computes the exponentially weighted mean and variance of the batch 
+ * with a two-pass and merges it with the old state, whose weight is (1 - alpha)^n: the result
+ * equals n single updates. */
+typedef struct ewma {
+    int64_t N;
+    double half_life;
+    double alpha;        /* Weight of a new sample */
+    double mu;
+    double var;
+    double t;            /* Time of the last sample (stats_add_ewma_at) */
+} s_ewma;
+
+
+static inline s_ewma stats_init_ewma(double half_life)
+{
+    return (s_ewma){ .half_life = half_life, .alpha = 1.0 - exp2(-1.0 / half_life) };
+}
+
+static inline s_ewma stats_ewma_update(s_ewma e, double x, double alpha)
+{
+    if (e.N == 0) {
+        e.mu = x;
+        e.var = 0;
+    } else {
+        double d = x - e.mu;
+        double incr = alpha * d;
+        e.mu += incr;
+        e.var = (1.0 - alpha) * (e.var + d * incr);
+    }
+    e.N++;
+    return e;
+}
+
+static inline s_ewma stats_add_ewma(s_ewma e, double x)
+{
+    return stats_ewma_update(e, x, e.alpha);
+}
+
+static inline s_ewma stats_add_ewma_at(s_ewma e, double t, double x)
+{   /* Irregularly spaced samples: the old state decays by 2^(-dt/half_life) */
+    double alpha = e.N == 0 ? 1.0 : 1.0 - exp2(-(t - e.t) / e.half_life);
+    e = stats_ewma_update(e, x, alpha);
+    e.t = t;
+    return e;
+}
+
+static inline s_ewma stats_add_array_ewma(s_ewma e, const double *x, size_t n)
+{
+    if (n == 0) return e;
+    if (e.N == 0) { e = stats_add_ewma(e, x[0]); x++; n--; }
+    if (n == 0) return e;
+
+    /* Weights alpha * beta^(n-1-i), oldest first; computed from the newest */
+    double beta = 1.0 - e.alpha;
+    double W = 0, sum = 0, w = e.alpha;
+    for (size_t i = n; i-- > 0; ) {
+        W += w;
+        sum += w * x[i];
+        w *= beta;
+    }
+    double mu_B = sum / W;
+    double sum2 = 0;
+    w = e.alpha;
+    for (size_t i = n; i-- > 0; ) {
+        double d = x[i] - mu_B;
+        sum2 += w * d * d;
+        w *= beta;
+    }
+    double var_B = sum2 / W;
+
+    /* Merge with the old state, of weight 1 - W = beta^n */
+    double W_A = 1.0 - W;
+    double d = mu_B - e.mu;
+    e.mu += W * d;
+    e.var = W_A * e.var + W * var_B + W_A * W * d * d;
+    e.N += n;
+    return e;
+}
+
+static inline double stats_ewma_mean(s_ewma e)
+{
+    return e.mu;
+}
+
+static inline double stats_ewma_variance(s_ewma e)
+{
+    return e.var;
+}
+
+static inline double stats_ewma_standard_deviation(s_ewma e)
+{
+    return sqrt(e.var);
+}
+
+
+
+
+
+/* Built-in 64-bit hashes for the sketches below: MurmurHash64A for byte strings and the 
+ * splitmix64 finaliser for integer keys */
+static inline uint64_t stats_hash_u64(uint64_t x)
+{
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static inline uint64_t stats_hash_bytes(const void *key, size_t len, uint64_t seed)
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    const unsigned char *p = key;
+    uint64_t h = seed ^ (len * m);
+    for (; len >= 8; len -= 8, p += 8) {
+        uint64_t k;
+        memcpy(&k, p, 8);
+        k *= m; k ^= k >> r; k *= m;
+        h ^= k;
+        h *= m;
+    }
+    if (len > 0) {
+        uint64_t k = 0;
+        memcpy(&k, p, len);
+        h ^= k;
+        h *= m;
+    }
+    h ^= h >> r; h *= m; h ^= h >> r;
+    return h;
+}
+
+
+
+
+/* Distinct counting with HyperLogLog. Dense: 2^p registers of one byte, relative error about
+ * 1.04/sqrt(2^p) (0.8% for p = 14, 16 kB). The estimate uses Ertl's (2017) improved 
+ * estimator, unbiased over the whole range without empirical tables. Small sets start in a 
+ * sparse representation (as in HLL++): a sorted list of 32-bit entries, each a 25-bit index
+ * and its rank, which is exact for small cardinalities and uses less memory; it is 
+ * converted to dense when it would exceed the size of the registers. Dense merges take the
+ * maximum of registers, 16 at a time with SSE2. */
+#define STATS_HLL_SPARSE_P 25
+#define STATS_HLL_BUFFER 256  /* Unsorted sparse insertions */
+
+typedef struct hll {
+    int p;
+    uint8_t *registers;  /* [2^p], NULL while sparse */
+    uint32_t *sparse;    /* Sorted sparse entries: index << 6 | rank */
+    int nsparse, max_sparse;
+    uint32_t buffer[STATS_HLL_BUFFER];
+    int nbuffer;
+} s_hll;
+
+
+static inline int stats_hll_init(s_hll *h, int p)
+{   /* p in [4, 18]. 0 ERROR, 1 OK */
+    memset(h, 0, sizeof(*h));
+    if (p < 4 || p > 18) {
+        fprintf(stderr, "stats_hll_init: precision must be in [4, 18].\n");
+        return 0;
+    }
+    h->p = p;
+    h->max_sparse = ((size_t)1 << p) / sizeof(uint32_t);
+    return 1;
+}
+
+static inline void stats_hll_free(s_hll *h)
+{
+    if (!h) return;
+    free(h->registers);
+    free(h->sparse);
+    memset(h, 0, sizeof(*h));
+}
+
+static inline int stats_hll_cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static inline void stats_hll_dense_set(s_hll *h, uint32_t entry)
+{   /* Moves a sparse entry (precision 25) into the registers (precision p) */
+    uint32_t idx = entry >> 6, rank = entry & 63;
+    int shift = STATS_HLL_SPARSE_P - h->p;
+    uint32_t low = idx & ((1u << shift) - 1);
+    uint8_t r = low ? (uint8_t)(shift - (31 - __builtin_clz(low))) : (uint8_t)(shift + rank);
+    uint8_t *reg = &h->registers[idx >> shift];
+    if (r > *reg) *reg = r;
+}
+
+static inline int stats_hll_to_dense(s_hll *h)
+{   /* 0 if ERROR (out of memory) */
+    if (h->registers) return 1;
+    h->registers = calloc((size_t)1 << h->p, 1);
+    if (!h->registers) { fprintf(stderr, "stats_hll: out of memory.\n"); return 0; }
+    for (int i = 0; i < h->nsparse; i++) stats_hll_dense_set(h, h->sparse[i]);
+    for (int i = 0; i < h->nbuffer; i++) stats_hll_dense_set(h, h->buffer[i]);
+    free(h->sparse);
+    h->sparse = NULL;
+    h->nsparse = h->nbuffer = 0;
+    return 1;
+}
+
+static inline int stats_hll_flush(s_hll *h)
+{   /* Sorts the buffer into the sparse list, keeping the highest rank per index */
+    if (h->nbuffer == 0) return 1;
+    qsort(h->buffer, h->nbuffer, sizeof(uint32_t), stats_hll_cmp_u32);
+    uint32_t *merged = malloc((h->nsparse + h->nbuffer) * sizeof(uint32_t));
+    if (!merged) return stats_hll_to_dense(h);  /* Needs no more memory than the merge */
+    int n = 0, i = 0, j = 0;
+    while (i < h->nsparse || j < h->nbuffer) {
+        uint32_t e = j >= h->nbuffer || (i < h->nsparse && h->sparse[i] <= h->buffer[j]) ? h->sparse[i++] : h->buffer[j++];
+        /* Same index: entries are sorted by rank too, keep the last */
+        if (n > 0 && (merged[n-1] >> 6) == (e >> 6)) merged[n-1] = e;
+        else merged[n++] = e;
+    }
+    free(h->sparse);
+    h->sparse = merged;
+    h->nsparse = n;
+    h->nbuffer = 0;
+    if (h->nsparse > h->max_sparse) return stats_hll_to_dense(h);
+    return 1;
+}
+
+static inline int stats_hll_add_entry(s_hll *h, uint32_t entry)
+{   /* Adds a sparse entry (precision 25), in the registers if already dense. 0 if ERROR (out of memory) */
+    if (h->nbuffer == STATS_HLL_BUFFER && !stats_hll_flush(h)) return 0;  /* A previous flush failed */
+    if (h->registers) { stats_hll_dense_set(h, entry); return 1; }
+    h->buffer[h->nbuffer++] = entry;
+    if (h->nbuffer == STATS_HLL_BUFFER) return stats_hll_flush(h);
+    return 1;
+}
+
+static inline int stats_hll_add_hash(s_hll *h, uint64_t hash)
+{   /* hash must be a good 64-bit hash. 0 if ERROR (out of memory) */
+    if (h->registers) {
+        uint64_t w = hash << h->p;
+        uint8_t r = w ? __builtin_clzll(w) + 1 : 64 - h->p + 1;
+        uint8_t *reg = &h->registers[hash >> (64 - h->p)];
+        if (r > *reg) *reg = r;
+        return 1;
+    }
+    uint64_t w = hash << STATS_HLL_SPARSE_P;
+    uint32_t rank = w ? __builtin_clzll(w) + 1 : 64 - STATS_HLL_SPARSE_P + 1;
+    return stats_hll_add_entry(h, (uint32_t)(hash >> (64 - STATS_HLL_SPARSE_P)) << 6 | rank);
+}
+
+static inline int stats_hll_add(s_hll *h, const void *key, size_t len)
+{
+    return stats_hll_add_hash(h, stats_hash_bytes(key, len, 0));
+}
+
+static inline int stats_hll_add_u64(s_hll *h, uint64_t key)
+{
+    return stats_hll_add_hash(h, stats_hash_u64(key));
+}
+
+static inline int stats_hll_merge(s_hll *h, const s_hll *other)
+{   /* h absorbs other (same precision). 0 ERROR, 1 OK */
+    if (h->p != other->p) {
+        fprintf(stderr, "stats_hll_merge: precisions differ.\n");
+        return 0;
+    }
+    if (!other->registers) {
+        for (int i = 0; i < other->nsparse + other->nbuffer; i++) {
+            uint32_t e = i < other->nsparse ? other->sparse[i] : other->buffer[i - other->nsparse];
+            if (!stats_hll_add_entry(h, e)) return 0;
+        }
+        return 1;
+    }
+    if (!stats_hll_to_dense(h)) return 0;
+    size_t m = (size_t)1 << h->p, i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= m; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(h->registers + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(other->registers + i));
+        _mm_storeu_si128((__m128i*)(h->registers + i), _mm_max_epu8(a, b));
+    }
+#endif
+    for (; i < m; i++) if (other->registers[i] > h->registers[i]) h->registers[i] = other->registers[i];
+    return 1;
+}
+
+static inline double stats_hll_sigma(double x)
+{
+    if (x == 1) return INFINITY;
+    double y = 1, z = x, z_old;
+    do {
+        x *= x;
+        z_old = z;
+        z += x * y;
+        y += y;
+    } while (z != z_old);
+    return z;
+}
+
+static inline double stats_hll_tau(double x)
+{
+    if (x == 0 || x == 1) return 0;
+    double y = 1, z = 1 - x, z_old;
+    do {
+        x = sqrt(x);
+        z_old = z;
+        y *= 0.5;
+        z -= (1 - x) * (1 - x) * y;
+    } while (z != z_old);
+    return z / 3;
+}
+
+static inline double stats_hll_estimate_counts(int p, int q, const int64_t *C)
+{   /* Ertl's improved estimator from the histogram C[0..q+1] of 2^p registers of q+1 bits */
+    double m = (double)((int64_t)1 << p);
+    double z = m * stats_hll_tau(1 - C[q + 1] / m);
+    for (int k = q; k >= 1; k--) z = 0.5 * (z + C[k]);
+    z += m * stats_hll_sigma(C[0] / m);
+    return m * m / (2 * STATS_LN2) / z;
+}
+
+static inline double stats_hll_count(s_hll *h)
+{   /* Estimated number of distinct keys */
+    int64_t C[66] = {0};
+    if (!h->registers) {
+        if (!stats_hll_flush(h)) return NAN;
+        if (!h->registers) {
+            /* Sparse: the estimator at precision 25, registers not in the list are zero */
+            int q = 64 - STATS_HLL_SPARSE_P;
+            C[0] = ((int64_t)1 << STATS_HLL_SPARSE_P) - h->nsparse;
+            for (int i = 0; i < h->nsparse; i++) C[h->sparse[i] & 63]++;
+            return stats_hll_estimate_counts(STATS_HLL_SPARSE_P, q, C);
+        }
+    }
+    size_t m = (size_t)1 << h->p;
+    for (size_t i = 0; i < m; i++) C[h->registers[i]]++;
+    return stats_hll_estimate_counts(h->p, 64 - h->p, C);
+}
+
+
+
+
+/* Frequency estimation with a Count-Min sketch (Cormode & Muthukrishnan), or a Count-Sketch
+ * (Charikar et al.), in depth rows of width counters. Row i uses the bucket h1 + i*h2 of 
+ * one 64-bit hash (Kirsch & Mitzenmacher). Count-Min never underestimates and overestimates
+ * by at most e/width * total with probability 1 - exp(-depth); Count-Sketch is unbiased, 
+ * with errors proportional to the L2 norm of the frequencies instead, which is better for 
+ * skewed streams, and supports negative updates. Optionally, the k keys with the largest 
+ * estimates are kept in a min-heap (heavy hitters), with a small hash table from key to heap
+ * slot so an update costs O(1) when the key is not a candidate. Keys are 64-bit: byte keys
+ * are tracked by their hash. Sketches with the same dimensions merge by adding counters. */
+typedef enum {
+    STATS_COUNT_MIN,
+    STATS_COUNT_SKETCH,
+} e_stats_sketch;
+
+typedef struct count_sketch {
+    e_stats_sketch type;
+    int width, depth;
+    int64_t *counters;   /* [depth][width] */
+    int64_t total;       /* Sum of all counts added */
+    int k, ntop;
+    uint64_t *top_keys;  /* Min-heap on top_counts */
+    int64_t *top_counts;
+    int *top_slots;      /* Linear probing, key -> heap slot + 1 (0 empty), [top_mask + 1] */
+    uint64_t top_mask;
+} s_count_sketch;
+
+
+static inline int stats_sketch_init(s_count_sketch *s, e_stats_sketch type, int width, int depth, int k)
+{   /* k = 0 disables top-k tracking. 0 ERROR, 1 OK */
+    memset(s, 0, sizeof(*s));
+    if (width < 1 || depth < 1 || k < 0) return 0;
+    s->type = type;
+    s->width = width;
+    s->depth = depth;
+    s->k = k;
+    s->top_mask = 1;
+    while (s->top_mask + 1 < 2 * (uint64_t)k) s->top_mask = 2 * s->top_mask + 1;  /* Load <= 1/2 */
+    s->counters = calloc((size_t)width * depth, sizeof(int64_t));
+    s->top_keys = malloc((k + 1) * sizeof(uint64_t));
+    s->top_counts = malloc((k + 1) * sizeof(int64_t));
+    s->top_slots = calloc(s->top_mask + 1, sizeof(int));
+    if (!s->counters || !s->top_keys || !s->top_counts || !s->top_slots) {
+        free(s->counters); free(s->top_keys); free(s->top_counts); free(s->top_slots);
+        memset(s, 0, sizeof(*s));
+        fprintf(stderr, "stats_sketch_init: out of memory.\n");
+        return 0;
+    }
+    return 1;
+}
+
+static inline void stats_sketch_free(s_count_sketch *s)
+{
+    if (!s) return;
+    free(s->counters);
+    free(s->top_keys);
+    free(s->top_counts);
+    free(s->top_slots);
+    memset(s, 0, sizeof(*s));
+}
+
+static inline int64_t stats_sketch_median(int64_t *v, int n)
+{   /* Insertion sort, n = depth is small */
+    for (int i = 1; i < n; i++) {
+        int64_t x = v[i];
+        int j = i - 1;
+        for (; j >= 0 && v[j] > x; j--) v[j + 1] = v[j];
+        v[j + 1] = x;
+    }
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static inline int64_t stats_sketch_update(s_count_sketch *s, uint64_t hash, int64_t count)
+{   /* Adds count to the key with this hash, returns its new estimate */
+    uint64_t h1 = hash, h2 = (hash >> 32) | (hash << 32) | 1;
+    int64_t est = INT64_MAX;
+    int64_t vals[64];
+    for (int i = 0; i < s->depth; i++) {
+        uint64_t hi = h1 + (uint64_t)i * h2;
+        int64_t *c = &s->counters[(size_t)i * s->width + (size_t)(((__uint128_t)hi * s->width) >> 64)];
+        if (s->type == STATS_COUNT_MIN) {
+            *c += count;
+            if (*c < est) est = *c;
+        } else {
+            int64_t sign = (hi >> 31) & 1 ? 1 : -1;
+            *c += sign * count;
+            if (i < 64) vals[i] = sign * *c;
+        }
+    }
+    s->total += count;
+    if (s->type == STATS_COUNT_SKETCH) est = stats_sketch_median(vals, s->depth < 64 ? s->depth : 64);
+    return est;
+}
+
+static inline int64_t stats_sketch_estimate_hash(const s_count_sketch *s, uint64_t hash)
+{
+    uint64_t h1 = hash, h2 = (hash >> 32) | (hash << 32) | 1;
+    int64_t est = INT64_MAX;
+    int64_t vals[64];
+    for (int i = 0; i < s->depth; i++) {
+        uint64_t hi = h1 + (uint64_t)i * h2;
+        int64_t c = s->counters[(size_t)i * s->width + (size_t)(((__uint128_t)hi * s->width) >> 64)];
+        if (s->type == STATS_COUNT_MIN) {
+            if (c < est) est = c;
+        } else {
+            if (i < 64) vals[i] = ((hi >> 31) & 1 ? 1 : -1) * c;
+        }
+    }
+    if (s->type == STATS_COUNT_SKETCH) est = stats_sketch_median(vals, s->depth < 64 ? s->depth : 64);
+    return est;
+}
+
+static inline int *stats_sketch_slot(const s_count_sketch *s, uint64_t key, uint64_t hash)
+{   /* Entry of key in top_slots, or the empty one where it would go */
+    uint64_t j = hash & s->top_mask;
+    while (s->top_slots[j] && s->top_keys[s->top_slots[j] - 1] != key) j = (j + 1) & s->top_mask;
+    return &s->top_slots[j];
+}
+
+static inline void stats_sketch_unslot(s_count_sketch *s, int *entry)
+{   /* Removes an entry of top_slots, shifting back the ones probed past it */
+    uint64_t i = entry - s->top_slots, j = i;
+    s->top_slots[i] = 0;
+    for (;;) {
+        j = (j + 1) & s->top_mask;
+        if (!s->top_slots[j]) return;
+        uint64_t home = stats_hash_u64(s->top_keys[s->top_slots[j] - 1]) & s->top_mask;
+        if (((j - home) & s->top_mask) >= ((j - i) & s->top_mask)) {
+            s->top_slots[i] = s->top_slots[j];
+            s->top_slots[j] = 0;
+            i = j;
+        }
+    }
+}
+
+static inline void stats_sketch_swap(s_count_sketch *s, int a, int b)
+{
+    int *sa = stats_sketch_slot(s, s->top_keys[a], stats_hash_u64(s->top_keys[a]));
+    int *sb = stats_sketch_slot(s, s->top_keys[b], stats_hash_u64(s->top_keys[b]));
+    *sa = b + 1;
+    *sb = a + 1;
+    int64_t c = s->top_counts[a]; s->top_counts[a] = s->top_counts[b]; s->top_counts[b] = c;
+    uint64_t k = s->top_keys[a]; s->top_keys[a] = s->top_keys[b]; s->top_keys[b] = k;
+}
+
+static inline void stats_sketch_sift_down(s_count_sketch *s, int i)
+{
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, min = i;
+        if (l < s->ntop && s->top_counts[l] < s->top_counts[min]) min = l;
+        if (r < s->ntop && s->top_counts[r] < s->top_counts[min]) min = r;
+        if (min == i) return;
+        stats_sketch_swap(s, i, min);
+        i = min;
+    }
+}
+
+static inline void stats_sketch_sift_up(s_count_sketch *s, int i)
+{
+    while (i > 0 && s->top_counts[(i - 1) / 2] > s->top_counts[i]) {
+        stats_sketch_swap(s, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static inline void stats_sketch_track(s_count_sketch *s, uint64_t key, uint64_t hash, int64_t est)
+{   /* Keeps key (hash = stats_hash_u64(key)) among the top k if its estimate is large enough */
+    if (s->k == 0) return;
+    int *entry = stats_sketch_slot(s, key, hash);
+    if (*entry) {
+        int i = *entry - 1;
+        s->top_counts[i] = est;
+        stats_sketch_sift_up(s, i);
+        stats_sketch_sift_down(s, i);
+    } else if (s->ntop < s->k) {
+        *entry = s->ntop + 1;
+        s->top_keys[s->ntop] = key;
+        s->top_counts[s->ntop] = est;
+        stats_sketch_sift_up(s, s->ntop++);
+    } else if (est > s->top_counts[0]) {
+        stats_sketch_unslot(s, stats_sketch_slot(s, s->top_keys[0], stats_hash_u64(s->top_keys[0])));
+        *stats_sketch_slot(s, key, hash) = 1;  /* The shift may have moved the empty entry */
+        s->top_keys[0] = key;
+        s->top_counts[0] = est;
+        stats_sketch_sift_down(s, 0);
+    }
+}
+
+static inline int64_t stats_sketch_add_u64(s_count_sketch *s, uint64_t key, int64_t count)
+{   /* Returns the new estimate of key */
+    uint64_t hash = stats_hash_u64(key);
+    int64_t est = stats_sketch_update(s, hash, count);
+    stats_sketch_track(s, key, hash, est);
+    return est;
+}
+
+static inline int64_t stats_sketch_add(s_count_sketch *s, const void *key, size_t len, int64_t count)
+{   /* Byte keys, tracked in the top k by their hash (stats_hash_bytes(key, len, 0)) */
+    uint64_t key_hash = stats_hash_bytes(key, len, 0), hash = stats_hash_u64(key_hash);
+    int64_t est = stats_sketch_update(s, hash, count);
+    stats_sketch_track(s, key_hash, hash, est);
+    return est;
+}
+
+static inline int64_t stats_sketch_estimate_u64(const s_count_sketch *s, uint64_t key)
+{
+    return stats_sketch_estimate_hash(s, stats_hash_u64(key));
+}
+
+static inline int64_t stats_sketch_estimate(const s_count_sketch *s, const void *key, size_t len)
+{
+    return stats_sketch_estimate_hash(s, stats_hash_u64(stats_hash_bytes(key, len, 0)));
+}
+
+static inline void stats_sketch_refresh_top(s_count_sketch *s, int nkeys, const uint64_t *keys)
+{   /* Rebuilds the top k from the current heap and extra candidate keys, with fresh estimates */
+    int n = s->ntop;
+    uint64_t *old = malloc((n + nkeys) * sizeof(uint64_t));
+    if (!old) return;
+    memcpy(old, s->top_keys, n * sizeof(uint64_t));
+    memcpy(old + n, keys, nkeys * sizeof(uint64_t));
+    s->ntop = 0;
+    memset(s->top_slots, 0, (s->top_mask + 1) * sizeof(int));
+    for (int i = 0; i < n + nkeys; i++) {
+        uint64_t hash = stats_hash_u64(old[i]);
+        stats_sketch_track(s, old[i], hash, stats_sketch_estimate_hash(s, hash));
+    }
+    free(old);
+}
+
+static inline int stats_sketch_merge(s_count_sketch *s, const s_count_sketch *other)
+{   /* s absorbs other (same type and dimensions). 0 ERROR, 1 OK */
+    if (s->type != other->type || s->width != other->width || s->depth != other->depth) {
+        fprintf(stderr, "stats_sketch_merge: sketches differ.\n");
+        return 0;
+    }
+    size_t n = (size_t)s->width * s->depth;
+    for (size_t i = 0; i < n; i++) s->counters[i] += other->counters[i];
+    s->total += other->total;
+    stats_sketch_refresh_top(s, other->ntop, other->top_keys);
+    return 1;
+}
+
+static inline int stats_sketch_top(const s_count_sketch *s, uint64_t keys[], int64_t counts[])
+{   /* Writes the tracked keys by decreasing estimate, returns how many (<= k) */
+    int n = s->ntop;
+    for (int i = 0; i < n; i++) { keys[i] = s->top_keys[i]; counts[i] = s->top_counts[i]; }
+    for (int i = 1; i < n; i++) {
+        uint64_t k = keys[i];
+        int64_t c = counts[i];
+        int j = i - 1;
+        for (; j >= 0 && counts[j] < c; j--) { keys[j + 1] = keys[j]; counts[j + 1] = counts[j]; }
+        keys[j + 1] = k;
+        counts[j + 1] = c;
+    }
+    return n;
+}
+
+
 #endif
 
 /* MIT License.